@@ -6,8 +6,6 @@ ICBSNode::ICBSNode(int num_of_agents) : parent(nullptr)
 	g_val = 0;
 	makespan = 0;
 	depth = 0;
-	positive_constraints.resize(num_of_agents);
-	negative_constraints.resize(num_of_agents);
 }
 #else
 ICBSNode::ICBSNode(vector<LPAStar*>& lpas) : parent(nullptr), lpas(lpas)
@@ -15,22 +13,16 @@ ICBSNode::ICBSNode(vector<LPAStar*>& lpas) : parent(nullptr), lpas(lpas)
 	g_val = 0;
 	makespan = 0;
 	depth = 0;
-	positive_constraints.resize(lpas.size());
-	negative_constraints.resize(lpas.size());
 }
 #endif
 
-ICBSNode::ICBSNode(ICBSNode* parent) : parent(parent), lpas(parent->lpas.size())
+ICBSNode::ICBSNode(ICBSNode* parent) : parent(parent), meta_agents(parent->meta_agents), lpas(parent->lpas.size())
 {
 	g_val = parent->g_val;
 	makespan = parent->makespan;
 	depth = parent->depth + 1;
 #ifndef LPA
-	positive_constraints.resize(parent->positive_constraints.size());
-	negative_constraints.resize(parent->negative_constraints.size());
 #else
-	positive_constraints.resize(lpas.size());
-	negative_constraints.resize(lpas.size());
 	for (int j = 0; j < parent->lpas.size(); ++j) {
 		lpas[j] = parent->lpas[j];
 	}
@@ -56,11 +48,7 @@ void ICBSNode::clear()
 int ICBSNode::add_constraint(const Constraint& constraint, const std::vector < std::unordered_map<int, AvoidanceState > >* cat,
         bool same_lpa_star /* = false*/)
 {
-    auto [loc1, loc2, constraint_timestep, positive_constraint] = constraint;
-    if (positive_constraint)
-	    positive_constraints[agent_id].push_back(constraint);
-    else
-        negative_constraints[agent_id].push_back(constraint);
+    constraints.emplace_back(agent_id, constraint);
 #ifndef LPA
 	return 0;
 #else
@@ -73,6 +61,10 @@ int ICBSNode::add_constraint(const Constraint& constraint, const std::vector < s
                 lpas[agent_id] = new LPAStar(*lpas[agent_id]);
             if (loc2 == -1)  // vertex constraint
                 lpas[agent_id]->addVertexConstraint(loc1, timestep, *cat);
+            else if (isLengthConstraint(constraint))
+                lpas[agent_id]->addLengthConstraint(timestep, *cat);
+            else if (isRangeConstraint(constraint))
+                lpas[agent_id]->addVertexRangeConstraint(loc1, timestep, rangeEnd(constraint), *cat);
             else
                 lpas[agent_id]->addEdgeConstraint(loc1, loc2, timestep, *cat);
         } else {
@@ -85,20 +77,40 @@ int ICBSNode::add_constraint(const Constraint& constraint, const std::vector < s
 #endif
 }
 
+int ICBSNode::add_barrier(const vector<Constraint>& barrier, const std::vector < std::unordered_map<int, AvoidanceState > >* cat,
+        bool same_lpa_star /* = false*/)
+{
+    int generated = 0;
+    for (const Constraint& constraint : barrier)
+    {
+        generated += add_constraint(constraint, cat, same_lpa_star);
+        same_lpa_star = true;  // The first constraint already copied it
+    }
+    return generated;
+}
+
 int ICBSNode::pop_constraint(const std::vector < std::unordered_map<int, AvoidanceState > >* cat)
 {
+    auto last = constraints.end();
+    do
+        --last;
+    while (last->first != agent_id || std::get<3>(last->second));  // The agent's last negative constraint
 #ifndef LPA
-    negative_constraints[agent_id].pop_back();
+    constraints.erase(last);
     return 0;
 #else
     if (lpas[agent_id] != nullptr) {
-        auto [loc1, loc2, timestep, positive_constraint] = negative_constraints[agent_id].back();
+        auto [loc1, loc2, timestep, positive_constraint] = last->second;
         // TODO: Support positive constraints
         int generated_before = lpas[agent_id]->allNodes_table.size();
         if (positive_constraint == false)  // negative constraint
         {
             if (loc2 == -1)  // vertex constraint
                 lpas[agent_id]->popVertexConstraint(loc1, timestep, *cat);
+            else if (isLengthConstraint(last->second))
+                lpas[agent_id]->popLengthConstraint(timestep, *cat);
+            else if (isRangeConstraint(last->second))
+                lpas[agent_id]->popVertexRangeConstraint(loc1, timestep, rangeEnd(last->second), *cat);
             else
                 lpas[agent_id]->popEdgeConstraint(loc1, loc2, timestep, *cat);
         } else {
@@ -106,13 +118,32 @@ int ICBSNode::pop_constraint(const std::vector < std::unordered_map<int, Avoidan
             // Replanning for the other agents when a positive constraint is added happens elsewhere
         }
 
-        negative_constraints[agent_id].pop_back();
+        constraints.erase(last);
         return lpas[agent_id]->allNodes_table.size() - generated_before;
     } else {
         std::cout << "LPA* " << agent_id << " unexpectedly null!" << std::endl;
         std::abort();
-        negative_constraints[agent_id].pop_back();
+        constraints.erase(last);
         return 0;
     }
 #endif
 }
+
+void ICBSNode::pop_landmark()
+{
+    auto last = constraints.end();
+    do
+        --last;
+    while (last->first != agent_id || !std::get<3>(last->second));
+    constraints.erase(last);
+}
+
+void ICBSNode::lastNegativeConstraints(int agent_id, vector<Constraint>& run) const
+{
+	run.clear();
+	auto it = constraints.rbegin();
+	while (it != constraints.rend() && it->first != agent_id)
+		++it;
+	for ( ; it != constraints.rend() && it->first == agent_id && !std::get<3>(it->second); ++it)
+		run.push_back(it->second);
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "MDD.h"
 #include "lpa_star.h"
+#include "conflict_pool.h"
 
 #include <list>
 #include <vector>
@@ -11,17 +12,25 @@
 class ICBSNode
 {
 public:
-	list<std::shared_ptr<Conflict>> cardinalConf;
-	list<std::shared_ptr<Conflict>> semiConf;
-	list<std::shared_ptr<Conflict>> nonConf;
-	list<std::shared_ptr<Conflict>> unknownConf;
+	// IDs of the conflicts in the search's conflict pool
+	vector<ConflictId> cardinalConf;
+	vector<ConflictId> semiConf;
+	vector<ConflictId> nonConf;
+	vector<ConflictId> unknownConf;
 
 	ICBSNode* parent;
-	std::shared_ptr<Conflict> conflict; // the chosen conflict
+	ConflictId conflict = NO_CONFLICT; // the chosen conflict
 	int agent_id; // the agent that constraints are imposed on - not anymore
-	vector<list<Constraint>> positive_constraints;
-	vector<list<Constraint>> negative_constraints;
+	// The constraints imposed at this node, each with the agent it's imposed on, in the order they were added.
+	// The constraints of the node's ancestors apply too, so a child only holds the few constraints it adds and its
+	// size doesn't depend on the number of agents.
+	vector<pair<int, Constraint>> constraints;
 	list<pair<int, vector<PathEntry>>> new_paths; // (agent id + its new path)
+	// The meta-agent of each agent, numbered by its smallest member, or -1 for agents that weren't merged with any
+	// other. nullptr until agents are merged on the branch.
+	std::shared_ptr<const vector<int>> meta_agents;
+	inline bool isMerged(int ag) const { return meta_agents != nullptr && (*meta_agents)[ag] >= 0; }
+	inline int metaAgentOf(int ag) const { return isMerged(ag) ? (*meta_agents)[ag] : ag; }
 
 	int g_val;
 	int h_val;
@@ -68,7 +77,14 @@ public:
 
 	// Returns the number of generated nodes
 	int add_constraint(const Constraint&, const std::vector < std::unordered_map<int, AvoidanceState > >* cat, bool same_lpa_star = false);
+	// Adds the negative vertex constraints of a barrier, copying the agent's LPA* instance at most once
+	int add_barrier(const vector<Constraint>& barrier, const std::vector < std::unordered_map<int, AvoidanceState > >* cat, bool same_lpa_star = false);
 	int pop_constraint(const std::vector < std::unordered_map<int, AvoidanceState > >* cat);
+	// Removes the last positive constraint of the agent. LPA* instances don't know about positive constraints.
+	void pop_landmark();
+	// The last run of negative constraints imposed on the agent at this node, latest first - a barrier is added as a
+	// run. Empty if there isn't one.
+	void lastNegativeConstraints(int agent_id, vector<Constraint>& run) const;
 
 	void clear();
 
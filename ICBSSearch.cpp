@@ -1,18 +1,24 @@
 #include "ICBSSearch.h"
 #include <filesystem>  // For exists
+#include <sstream>  // For ostringstream
+#include <thread>
+#include <unistd.h>  // For sysconf
 
 //////////////////// HIGH LEVEL HEURISTICS ///////////////////////////
 // compute heuristics for the high-level search
-int ICBSSearch::computeHeuristics(const ICBSNode& curr)
+int ICBSSearch::computeHeuristics(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths)
 {
+	if (heuristic_type == heuristics_type::WDG)
+		return computeWDGHeuristics(curr, the_paths);
+
 	// build conflict graph
 	vector<vector<bool>> CG(num_of_agents);
 	int num_of_CGnodes = 0, num_of_CGedges = 0;
 	for (int i = 0; i < num_of_agents; i++)
 		CG[i].resize(num_of_agents, false);
-	for (list<std::shared_ptr<Conflict>>::const_iterator it = curr.cardinalConf.begin(); it != curr.cardinalConf.end(); ++it)
+	for (ConflictId id : curr.cardinalConf)
 	{
-		auto [agent1, agent2, loc1, loc2, timestep] = **it;
+		auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[id];
 		if (!CG[agent1][agent2])
 		{
 			CG[agent1][agent2] = true;
@@ -38,7 +44,8 @@ int ICBSSearch::computeHeuristics(const ICBSNode& curr)
 	}
 
 	// Minimum Vertex Cover
-	if (curr.parent == NULL) // root node of CBS tree
+	if (curr.parent == NULL || curr.meta_agents != nullptr) // root node of CBS tree, or meta-agents were merged and
+	                                                         // replanning one can drop the edges of several agents
 	{
 		int i = 1;
 		while (!KVertexCover(CG, num_of_CGnodes, num_of_CGedges, i))
@@ -99,26 +106,400 @@ bool ICBSSearch::KVertexCover(const vector<vector<bool>>& CG, int num_of_CGnodes
 	return false;
 }
 
+// Find the first conflict between the paths of a pair of agents, or return false if there isn't one.
+// The agents are numbered 0 and 1 in the returned conflict.
+static bool findFirstConflict(const vector<PathEntry>* paths[2], Conflict& conflict)
+{
+	int min_path_length = (int)min(paths[0]->size(), paths[1]->size());
+	for (int timestep = 0; timestep < min_path_length; timestep++)
+	{
+		int loc1 = paths[0]->at(timestep).location;
+		int loc2 = paths[1]->at(timestep).location;
+		if (loc1 == loc2)
+		{
+			conflict = make_tuple(0, 1, loc1, -1, timestep);
+			return true;
+		}
+		else if (timestep < min_path_length - 1
+			&& loc1 == paths[1]->at(timestep + 1).location
+			&& loc2 == paths[0]->at(timestep + 1).location)
+		{
+			conflict = make_tuple(0, 1, loc1, loc2, timestep + 1);  // edge conflict
+			return true;
+		}
+	}
+	if (paths[0]->size() != paths[1]->size())  // check whether there are conflicts that occur after one agent reaches its goal
+	{
+		int a1_ = paths[0]->size() < paths[1]->size() ? 0 : 1;
+		int a2_ = 1 - a1_;
+		int loc1 = paths[a1_]->back().location;
+		for (int timestep = min_path_length; timestep < (int)paths[a2_]->size(); timestep++)
+		{
+			if (paths[a2_]->at(timestep).location == loc1)
+			{
+				conflict = make_tuple(a1_, a2_, loc1, -1, timestep);
+				return true;
+			}
+		}
+	}
+	return false;
+}
 
-//////////////////// CONSTRAINTS ///////////////////////////
-// collect constraints from ancestors
-void ICBSSearch::collectConstraints(ICBSNode* curr, std::list<pair<int, Constraint>> &constraints)
+// Compute the WDG heuristic: the edge-weighted minimum vertex cover of the pairwise dependency graph,
+// where the weight of an edge is the cost increase of solving its two agents optimally together
+int ICBSSearch::computeWDGHeuristics(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths)
+{
+	vector<vector<int>> WDG(num_of_agents, vector<int>(num_of_agents, 0));
+	vector<vector<bool>> checked(num_of_agents, vector<bool>(num_of_agents, false));
+	for (const auto* confs : {&curr.cardinalConf, &curr.semiConf, &curr.nonConf, &curr.unknownConf})
+	{
+		for (ConflictId id : *confs)
+		{
+			auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[id];
+			if (checked[agent1][agent2] || curr.isMerged(agent1) || curr.isMerged(agent2))
+				continue;  // The pair costs of members of meta-agents aren't increases over optimal costs of their own
+			checked[agent1][agent2] = true;
+			checked[agent2][agent1] = true;
+			int w = getPairCostIncrease(curr, the_paths, agent1, agent2);
+			WDG[agent1][agent2] = w;
+			WDG[agent2][agent1] = w;
+		}
+	}
+	// A cardinal conflict increases the cost of the pair by at least 1 even if its sub-problem was cut short
+	for (ConflictId id : curr.cardinalConf)
+	{
+		auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[id];
+		if (WDG[agent1][agent2] == 0)
+		{
+			WDG[agent1][agent2] = 1;
+			WDG[agent2][agent1] = 1;
+		}
+	}
+	return minimumWeightedVertexCover(WDG);
+}
+
+// Returns how much more the pair of agents costs when solved together than their current paths cost
+int ICBSSearch::getPairCostIncrease(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths, int a1, int a2)
+{
+	if (a1 > a2)
+		std::swap(a1, a2);
+	WDGCacheKey key{a1, a2, hashConstraintsOfAgent(&curr, a1), hashConstraintsOfAgent(&curr, a2)};
+	int pair_cost = -1;
+	{
+		std::lock_guard<std::mutex> lock(shared->wdg_cache_mutex);
+		auto it = wdg_cache.find(key);
+		if (it != wdg_cache.end())
+		{
+			wdg_num_cache_hits++;
+			pair_cost = it->second;
+		}
+	}
+	if (pair_cost < 0)
+	{
+		pair_cost = solve2Agents(curr, the_paths, a1, a2);
+		std::lock_guard<std::mutex> lock(shared->wdg_cache_mutex);
+		if (wdg_cache.size() >= wdg_max_cache_entries)
+			wdg_cache.clear();
+		wdg_cache[key] = pair_cost;
+	}
+	return max(pair_cost - ((int)the_paths[a1]->size() - 1) - ((int)the_paths[a2]->size() - 1), 0);
+}
+
+// The hash of a single constraint for hashConstraintsOfAgent.
+// kind: 0 - a negative constraint, 1 - a landmark
+// Different seeds give independent hashes.
+static size_t hashConstraint(const Constraint& con, int kind, uint64_t seed = 0x9e3779b97f4a7c15ULL)
+{
+	auto [loc1, loc2, timestep, positive_constraint] = con;
+	uint64_t x = (uint64_t)(loc1 + 1);
+	x = x * 1000003 ^ (uint64_t)(loc2 + 1);
+	x = x * 1000003 ^ (uint64_t)timestep;
+	x = x * 4 + kind;
+	// splitmix64 finalizer, so summing the hashes of different constraints doesn't cancel out
+	x += seed;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return (size_t)(x ^ (x >> 31));
+}
+
+// The seed of the check hash of the constraints
+static const uint64_t check_seed = 0x632be59bd9b4e019ULL;
+
+// Two independent order-independent hashes of the constraints on the branch of the given node that affect the given
+// agent: a key, and a check that tells apart branches whose keys collide.
+// They're sums of the hashes of the constraints, so the hashes of the branch without one of them are easy to find.
+pair<size_t, size_t> ICBSSearch::hashConstraintsOfAgent(const ICBSNode* curr, int agent_id) const
 {
+	size_t key = 0;
+	size_t check = 0;
 	while (curr != nullptr)
 	{
-		for (auto con : curr->positive_constraints[curr->agent_id])
+		for (const auto& [ag, con] : curr->constraints)
+		{
+			if (ag != agent_id)
+				continue;
+			int kind = std::get<3>(con) ? 1 : 0;  // a landmark or a negative constraint
+			key += hashConstraint(con, kind);
+			check += hashConstraint(con, kind, check_seed);
+		}
+		curr = curr->parent;
+	}
+	return make_pair(key, check);
+}
+
+// Two independent order-independent hashes of all the constraints on the branch of the given node: the key of the
+// ID-CBSH transposition table, and a check that tells apart branches whose keys collide
+pair<size_t, size_t> ICBSSearch::hashConstraints(const ICBSNode* curr) const
+{
+	size_t key = 0;
+	size_t check = 0;
+	while (curr != nullptr)
+	{
+		for (const auto& [ag, con] : curr->constraints)
+		{
+			int kind = std::get<3>(con) ? 1 : 0;
+			key += hashConstraint(con, kind) * (2 * (size_t)ag + 1);
+			check += hashConstraint(con, kind, check_seed * (2 * (uint64_t)ag + 1));
+		}
+		curr = curr->parent;
+	}
+	return make_pair(key, check);
+}
+
+// Solve the sub-problem of agents a1 and a2 under the constraints of the given node with a small CBS that uses the
+// agents' A* engines, and return the optimal cost of the pair.
+// The agents' current paths (found by their LPA* instances) are reused as the root of the sub-problem unless the
+// agents have landmarks. Landmarks (positive constraints on the agents themselves) are relaxed, so the result is a
+// lower bound on the cost of the pair in every descendant of the node.
+// If the sub-problem isn't solved within wdg_max_subproblem_nodes expansions, the lowest cost in its OPEN is
+// returned instead - still a lower bound.
+int ICBSSearch::solve2Agents(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths, int a1, int a2)
+{
+	struct SubNode
+	{
+		vector<PathEntry> paths[2];
+		int parent;  // index in the nodes vector, -1 for the root
+		int agent;  // 0 or 1 - the agent the constraint is imposed on
+		Constraint constraint;
+		int cost;
+	};
+
+	wdg_num_subproblems++;
+	int agents[2] = {a1, a2};
+	std::vector<std::unordered_map<int, AvoidanceState> > empty_cat(1);
+	std::vector<std::unordered_map<int, ConstraintState> > base_cons_tables[2];
+	int base_last_goal_cons_timestep[2];
+	vector<SubNode> nodes(1);
+	nodes[0].parent = -1;
+	nodes[0].agent = -1;
+	for (int k = 0; k < 2; k++)
+	{
+		int ag = agents[k];
+		base_cons_tables[k].resize(curr.makespan + 1);
+		pair<int, int> start(search_engines[ag]->start_location, 0), goal(search_engines[ag]->goal_location, INT_MAX);
+		base_last_goal_cons_timestep[k] = buildConstraintTable(&curr, ag, 0, base_cons_tables[k], start, goal);
+		if (goal.second == INT_MAX)  // No landmarks - the current path is optimal for the constraint table
+			nodes[0].paths[k] = *the_paths[ag];
+		else
+		{
+			start = make_pair(search_engines[ag]->start_location, 0);
+			goal = make_pair(search_engines[ag]->goal_location, INT_MAX);
+			bool found = search_engines[ag]->findShortestPath(nodes[0].paths[k], base_cons_tables[k], empty_cat,
+			                                                  start, goal, 0, base_last_goal_cons_timestep[k]);
+			LL_num_expanded += search_engines[ag]->num_expanded;
+			LL_num_generated += search_engines[ag]->num_generated;
+			if (!found)  // Can't happen - the current path satisfies the relaxed constraints
+				nodes[0].paths[k] = *the_paths[ag];
+		}
+	}
+	nodes[0].cost = (int)nodes[0].paths[0].size() - 1 + (int)nodes[0].paths[1].size() - 1;
+
+	// (cost, index in nodes)
+	std::priority_queue<pair<int, int>, vector<pair<int, int>>, std::greater<pair<int, int>>> open;
+	open.push(make_pair(nodes[0].cost, 0));
+	int num_expanded = 0;
+	while (!open.empty())
+	{
+		auto [cost, id] = open.top();
+		if (num_expanded >= wdg_max_subproblem_nodes)
+			return cost;
+		open.pop();
+
+		const vector<PathEntry>* node_paths[2] = {&nodes[id].paths[0], &nodes[id].paths[1]};
+		Conflict conflict;
+		if (!findFirstConflict(node_paths, conflict))
+			return cost;
+		num_expanded++;
+
+		auto [agent1, agent2, location1, location2, timestep] = conflict;
+		for (int k = 0; k < 2; k++)
+		{
+			SubNode child;
+			child.parent = id;
+			child.agent = k;
+			if (location2 >= 0 && k == agent2)  // the constraint is on traversing the edge in the opposite direction
+				child.constraint = make_tuple(location2, location1, timestep, false);
+			else
+				child.constraint = make_tuple(location1, location2, timestep, false);
+			child.paths[1 - k] = nodes[id].paths[1 - k];
+
+			// Add the constraints of this branch of the sub-problem to the agent's constraint table
+			int ag = agents[k];
+			std::vector<std::unordered_map<int, ConstraintState> > cons_table(base_cons_tables[k]);
+			int last_goal_cons_timestep = base_last_goal_cons_timestep[k];
+			for (const SubNode* n = &child; n->parent != -1; n = &nodes[n->parent])
+			{
+				if (n->agent != k)
+					continue;
+				auto [loc1, loc2, constraint_timestep, positive_constraint] = n->constraint;
+				growConstraintTable(cons_table, constraint_timestep + 1);
+				if (loc2 < 0) // vertex constraint
+				{
+					cons_table[constraint_timestep][loc1].vertex = true;
+					if (loc1 == search_engines[ag]->goal_location && last_goal_cons_timestep < constraint_timestep)
+						last_goal_cons_timestep = constraint_timestep;
+				}
+				else // edge constraint
+				{
+					for (int i = 0; i < MapLoader::valid_moves_t::WAIT_MOVE; i++)
+					{
+						if (loc2 - loc1 == moves_offset[i])
+							cons_table[constraint_timestep][loc2].edge[i] = true;
+					}
+				}
+			}
+
+			pair<int, int> start(search_engines[ag]->start_location, 0), goal(search_engines[ag]->goal_location, INT_MAX);
+			bool found = search_engines[ag]->findShortestPath(child.paths[k], cons_table, empty_cat, start, goal,
+			                                                  (int)nodes[id].paths[k].size() - 1,
+			                                                  last_goal_cons_timestep);
+			LL_num_expanded += search_engines[ag]->num_expanded;
+			LL_num_generated += search_engines[ag]->num_generated;
+			if (!found)
+				continue;
+			child.cost = (int)child.paths[0].size() - 1 + (int)child.paths[1].size() - 1;
+			nodes.push_back(std::move(child));
+			open.push(make_pair(nodes.back().cost, (int)nodes.size() - 1));
+		}
+	}
+	return nodes[0].cost;  // No solution for the pair at all. Don't prune here - let the main search find out.
+}
+
+// Edge-weighted minimum vertex cover: the minimum sum of non-negative integers x such that
+// x[i] + x[j] >= WDG[i][j] for every pair of agents. Solved exactly for every connected component that's small
+// enough, and bounded from below by a greedy matching for larger ones.
+int ICBSSearch::minimumWeightedVertexCover(const vector<vector<int>>& WDG)
+{
+	constexpr int MAX_EXACT_COMPONENT_SIZE = 10;
+	int rst = 0;
+	vector<bool> done(num_of_agents, false);
+	for (int i = 0; i < num_of_agents; i++)
+	{
+		if (done[i])
+			continue;
+		// Collect the connected component of agent i
+		vector<int> component;
+		std::queue<int> Q;
+		Q.push(i);
+		done[i] = true;
+		while (!Q.empty())
+		{
+			int j = Q.front();
+			Q.pop();
+			component.push_back(j);
+			for (int k = 0; k < num_of_agents; k++)
+			{
+				if (WDG[j][k] > 0 && !done[k])
+				{
+					done[k] = true;
+					Q.push(k);
+				}
+			}
+		}
+		if (component.size() == 1)
+			continue;
+		else if (component.size() <= MAX_EXACT_COMPONENT_SIZE)
 		{
-			constraints.push_back(make_pair(curr->agent_id, con));
+			// Every agent taking its maximal incident weight is always a cover
+			int upper_bound = 0;
+			for (int j : component)
+				upper_bound += *std::max_element(WDG[j].begin(), WDG[j].end());
+			vector<int> x(component.size(), 0);
+			rst += weightedVertexCover(WDG, component, x, 0, 0, upper_bound);
 		}
-		for (auto con : curr->negative_constraints[curr->agent_id])
+		else
 		{
-			constraints.push_back(make_pair(curr->agent_id, con));
+			// The weights of edges that don't share an agent must be covered separately
+			vector<tuple<int, int, int>> edges;
+			for (int j : component)
+				for (int k : component)
+					if (j < k && WDG[j][k] > 0)
+						edges.push_back(make_tuple(WDG[j][k], j, k));
+			std::sort(edges.rbegin(), edges.rend());
+			vector<bool> matched(num_of_agents, false);
+			for (auto [w, j, k] : edges)
+			{
+				if (matched[j] || matched[k])
+					continue;
+				matched[j] = true;
+				matched[k] = true;
+				rst += w;
+			}
 		}
+	}
+	return rst;
+}
+
+// Branch and bound over the values of the agents in the component, in order.
+// Returns the minimal cover found that's smaller than best_so_far, or best_so_far.
+int ICBSSearch::weightedVertexCover(const vector<vector<int>>& WDG, const vector<int>& nodes, vector<int>& x,
+                                    int i, int sum, int best_so_far)
+{
+	if (sum >= best_so_far)
+		return best_so_far;
+	else if (i == (int)nodes.size())
+		return sum;
+	// x[i] must cover the edges to the agents that were already assigned,
+	// and never needs to be larger than its largest edge
+	int min_value = 0, max_value = 0;
+	for (int j = 0; j < (int)nodes.size(); j++)
+	{
+		int w = WDG[nodes[i]][nodes[j]];
+		if (j < i)
+			min_value = max(min_value, w - x[j]);
+		max_value = max(max_value, w);
+	}
+	for (int value = min_value; value <= max_value; value++)
+	{
+		x[i] = value;
+		best_so_far = weightedVertexCover(WDG, nodes, x, i + 1, sum + value, best_so_far);
+	}
+	return best_so_far;
+}
+
+
+//////////////////// CONSTRAINTS ///////////////////////////
+// collect constraints from ancestors
+void ICBSSearch::collectConstraints(ICBSNode* curr, std::list<pair<int, Constraint>> &constraints)
+{
+	while (curr != nullptr)
+	{
+		for (const auto& [ag, con] : curr->constraints)
+			constraints.push_back(make_pair(ag, con));
 		curr = curr->parent;
 	}
 	// TODO: Use this function.
 }
 
+// Narrow the start or the goal of replanning a path around the timestep to the landmark if it's between them
+static void applyLandmark(int loc, int landmark_timestep, int timestep, pair<int, int>& start, pair<int, int>& goal)
+{
+	if (start.second < landmark_timestep && landmark_timestep < timestep)  // the landmark is between (start.second, timestep)
+		start = make_pair(loc, landmark_timestep);
+	else if (timestep <= landmark_timestep && landmark_timestep < goal.second)  // the landmark is between [timestep, goal.second)
+		goal = make_pair(loc, landmark_timestep);
+}
+
 // build the constraint table for replanning agent <agent_id>,
 // and find the two closest landmarks for agent <agent_id> that have the new constraint at time step <timestep> between them.
 // TODO: Consider splitting into two functions
@@ -136,55 +517,36 @@ int ICBSSearch::buildConstraintTable(ICBSNode* curr, int agent_id, int timestep,
 	list < Constraint > constraints_negative;
 	while (curr != nullptr)
 	{
-		for (auto con: curr->negative_constraints[agent_id]) {
+		for (const auto& [ag, con] : curr->constraints) {
 			auto [loc1, loc2, constraint_timestep, positive_constraint] = con;
+			if (ag != agent_id || positive_constraint)
+				continue;
+			if (isLengthConstraint(con))
+			{  // The path may not end at or before the timestep - same as a constraint on staying at the goal then
+				if (loc2 == goal.first && lastGoalConsTimestep < constraint_timestep)
+					lastGoalConsTimestep = constraint_timestep;
+				continue;
+			}
 			constraints_negative.push_back(con);
-			if (loc1 == goal.first && loc2 < 0 && lastGoalConsTimestep < constraint_timestep)
-				lastGoalConsTimestep = constraint_timestep;
+			int last_timestep = isRangeConstraint(con) ? rangeEnd(con) : constraint_timestep;
+			if (loc1 == goal.first && loc2 < 0 && lastGoalConsTimestep < last_timestep)
+				lastGoalConsTimestep = last_timestep;
 		}
 
-		for (int j = 0; j < num_of_agents ; ++j) {
-			if (curr->agent_id == agent_id) // for the constrained agent, those are landmarks
+		// A positive constraint is a landmark of the agent it's on - the other agents that conflicted with it have
+		// explicit negative constraints
+		for (const auto& [ag, con] : curr->constraints) {
+			auto [loc1, loc2, constraint_timestep, positive_constraint] = con;
+			if (ag != agent_id || !positive_constraint)
+				continue;
+			if (loc2 < 0) // vertex constraint
+				applyLandmark(loc1, constraint_timestep, timestep, start, goal);
+			else // edge constraint, viewed as two landmarks on the from-vertex and the to-vertex
 			{
-				for (auto con: curr->positive_constraints[agent_id]) {
-					auto[loc1, loc2, constraint_timestep, positive_constraint] = con;
-
-					if (loc2 < 0) // vertex constraint
-					{
-						if (start.second < constraint_timestep && constraint_timestep < timestep)  // This landmark is between (start.second, timestep)
-						{ // update start
-							start.first = loc1;
-							start.second = constraint_timestep;
-						} else if (timestep <= constraint_timestep && constraint_timestep < goal.second)  // the landmark is between [timestep, goal.second)
-						{ // update goal
-							goal.first = loc1;
-							goal.second = constraint_timestep;
-							// If the landmark is at the same timestep as the new constraint, planning the new path will surely fail
-						}
-					} else // edge constraint, viewed as two landmarks on the from-vertex and the to-vertex
-					{
-						if (start.second < constraint_timestep && constraint_timestep < timestep)  // the second landmark is between (start.second, timestep)
-						{ // update start
-							start.first = loc2;
-							start.second = constraint_timestep;
-						} else if (timestep <= constraint_timestep - 1 && constraint_timestep - 1 < goal.second)  // the first landmark is between [timestep, goal.second)
-						{ // update goal
-							goal.first = loc1;
-							goal.second = constraint_timestep - 1;
-						}
-					}
-					constraints_positive.push_back(con);
-				}
-			}
-			else {  // for the other agents, it is equivalent to a negative constraint
-				for (auto con: curr->positive_constraints[agent_id]) {
-					auto [loc1, loc2, constraint_timestep, positive_constraint] = con;
-					if (loc1 == goal.first && loc2 < 0 && lastGoalConsTimestep < constraint_timestep) {
-						lastGoalConsTimestep = constraint_timestep;
-					}
-					constraints_negative.push_back(con);
-				}
+				applyLandmark(loc1, constraint_timestep - 1, timestep, start, goal);
+				applyLandmark(loc2, constraint_timestep, timestep, start, goal);
 			}
+			constraints_positive.push_back(con);
 		}
 		curr = curr->parent;
 	}
@@ -195,34 +557,31 @@ int ICBSSearch::buildConstraintTable(ICBSNode* curr, int agent_id, int timestep,
 	for (list< Constraint >::iterator it = constraints_negative.begin(); it != constraints_negative.end(); it++) 
 	{
 		auto [loc1, loc2, constraint_timestep, positive_constraint] = *it;
-		if (!positive_constraint)
+		if (loc2 == -1) // vertex constraint
+			cons_table[constraint_timestep][loc1].vertex = true;
+		else if (isRangeConstraint(*it) && rangeEnd(*it) == FOREVER)
 		{
-			if (loc2 < 0) // vertex constraint
-				cons_table[constraint_timestep][loc1].vertex = true;
-			else // edge constraint
-			{
-				for(int i = 0; i < MapLoader::valid_moves_t::WAIT_MOVE; i++)
-				{
-					if (loc2 - loc1 == moves_offset[i])
-					{
-						cons_table[constraint_timestep][loc2].edge[i] = true;
-					}
-				}
-			}
+			growConstraintTable(cons_table, constraint_timestep + 1);
+			for (int t = constraint_timestep; t < (int)cons_table.size(); t++)
+				cons_table[t][loc1].vertex = true;
+			cons_table.back()[loc1].forever = true;
 		}
-		else if (loc2 < 0)  // positive vertex constraint for other agent
-			cons_table[constraint_timestep][loc1].vertex = true;
-		else  // positive edge constraint for other agent
+		else if (isRangeConstraint(*it))
 		{
-			cons_table[constraint_timestep - 1][loc1].vertex = true;
-			cons_table[constraint_timestep][loc2].vertex = true;
-			for (int i = 0; i < MapLoader::valid_moves_t::WAIT_MOVE; i++)
+			growConstraintTable(cons_table, rangeEnd(*it) + 1);
+			for (int t = constraint_timestep; t <= rangeEnd(*it); t++)
+				cons_table[t][loc1].vertex = true;
+		}
+		else // edge constraint
+		{
+			for(int i = 0; i < MapLoader::valid_moves_t::WAIT_MOVE; i++)
 			{
-				if (loc1 - loc2 == moves_offset[i])
-					cons_table[constraint_timestep][loc1].edge[i] = true;
+				if (loc2 - loc1 == moves_offset[i])
+				{
+					cons_table[constraint_timestep][loc2].edge[i] = true;
+				}
 			}
 		}
-			
 	}
 	return lastGoalConsTimestep;
 }
@@ -352,112 +711,88 @@ void ICBSSearch::clearConflictsOfAgent(ICBSNode &curr, int ag)
 // copy conflicts from "from" to "to" if the paths of both agents remain unchanged
 // according to the given array
 void ICBSSearch::copyConflicts(const vector<bool>& unchanged, 
-	const list<std::shared_ptr<Conflict>>& from, list<std::shared_ptr<Conflict>>& to)
+	const vector<ConflictId>& from, vector<ConflictId>& to)
 {
-	for (const auto& conflict : from)
+	to.reserve(to.size() + from.size());
+	for (ConflictId id : from)
 	{
-		auto [agent1, agent2, loc1, loc2, timestep] = *conflict;
+		auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[id];
 		if (unchanged[agent1] && unchanged[agent2])
-			to.push_back(conflict);
+			to.push_back(id);
 	}
 }
 
 // Of changed agents
 void ICBSSearch::clearConflictsOfAffectedAgents(bool *unchanged,
-                                                list<std::shared_ptr<Conflict>> &lst)
+                                                vector<ConflictId> &lst)
 {
-	auto it = lst.begin();
-	while (it != lst.end()) {
-		auto [agent1, agent2, loc1, loc2, timestep] = **it;
-		if (!unchanged[agent1] || !unchanged[agent2])
-			it = lst.erase(it);
-		else
-			++it;
-
-	}
+	lst.erase(std::remove_if(lst.begin(), lst.end(), [&](ConflictId id) {
+		auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[id];
+		return !unchanged[agent1] || !unchanged[agent2];
+	}), lst.end());
 }
 
 // find all conflict in the current solution
 void ICBSSearch::findConflicts(ICBSNode& curr)
 {
+	vector<bool> detected(num_of_agents, false);
 	if (curr.parent != nullptr) // not root node
 	{
+		// Bring the occupancy index up to date with the paths of the node
+		for (int ag = 0; ag < num_of_agents; ag++)
+			occupancy_index.syncPath(ag, paths[ag]);
+		for (const auto& newPath : curr.new_paths)
+			occupancy_index.addPath(newPath.first, paths[newPath.first]);
+
 		// detect conflicts that occur on the new planned paths
-		vector<bool> detected(num_of_agents, false);
-		for (list<pair<int, vector<PathEntry>>>::const_iterator it = curr.new_paths.begin(); it != curr.new_paths.end(); it++)
+		for (const auto& newPath : curr.new_paths)
 		{
-			int a1 = it->first;
+			int a1 = newPath.first;
 			detected[a1] = true;
-			for (int a2 = 0; a2 < num_of_agents; a2++)
-			{
-				if (detected[a2])
-					continue;
-				findConflicts(paths, a1, a2, curr);
-			}
+			occupancy_index.findConflicts(a1, detected, conflict_pool, curr.unknownConf);
 		}
 	}
 	else // root node
 	{ // detect conflicts among all paths
+		for (int ag = 0; ag < num_of_agents; ag++)
+			occupancy_index.addPath(ag, paths[ag]);
 		for(int a1 = 0; a1 < num_of_agents ; a1++)
 		{
-			for (int a2 = a1 + 1; a2 < num_of_agents; a2++)
-			{
-				findConflicts(paths, a1, a2, curr);
-			}
+			detected[a1] = true;
+			occupancy_index.findConflicts(a1, detected, conflict_pool, curr.unknownConf);
 		}
 	}
 }
 
-// find conflicts between paths of agents a1 and a2
-void ICBSSearch::findConflicts(vector<vector<PathEntry> *> &the_paths, int a1, int a2, ICBSNode &curr)
+// find the conflicts of an agent whose path was just changed (possibly in place) with all other agents
+void ICBSSearch::findConflictsOfAgent(ICBSNode &curr, vector<vector<PathEntry> *> &the_paths, int ag)
 {
-	size_t min_path_length = the_paths[a1]->size() < the_paths[a2]->size() ? the_paths[a1]->size() : the_paths[a2]->size();
-	for (int timestep = 0; timestep < min_path_length; timestep++)
-	{
-		int loc1 = the_paths[a1]->at(timestep).location;
-		int loc2 = the_paths[a2]->at(timestep).location;
-		if (loc1 == loc2)
-		{
-			curr.unknownConf.push_back(std::shared_ptr<Conflict>(new Conflict(a1, a2, loc1, -1, timestep)));
-		}
-		else if (timestep < min_path_length - 1
-			&& loc1 == the_paths[a2]->at(timestep + 1).location
-			&& loc2 == the_paths[a1]->at(timestep + 1).location)
-		{
-			curr.unknownConf.push_back(std::shared_ptr<Conflict>(new Conflict(a1, a2, loc1, loc2, timestep + 1))); // edge conflict
-		}
-	}
-	if (the_paths[a1]->size() != the_paths[a2]->size()) // check whether there are conflicts that occur after one agent reaches its goal
-	{
-		int a1_ = the_paths[a1]->size() < the_paths[a2]->size() ? a1 : a2;
-		int a2_ = the_paths[a1]->size() < the_paths[a2]->size() ? a2 : a1;
-		int loc1 = the_paths[a1_]->back().location;
-		for (int timestep = (int)min_path_length; timestep < the_paths[a2_]->size(); timestep++)
-		{
-			int loc2 = the_paths[a2_]->at(timestep).location;
-			if (loc1 == loc2)
-			{ // It's at least a semi cardinal conflict
-				curr.unknownConf.push_front(std::shared_ptr<Conflict>(new Conflict(a1_, a2_, loc1, -1, timestep))); 
-			}
-		}
-	}
+	clearConflictsOfAgent(curr, ag);
+	occupancy_index.addPath(ag, the_paths[ag]);
+	vector<bool> skip(num_of_agents, false);
+	skip[ag] = true;
+	occupancy_index.findConflicts(ag, skip, conflict_pool, curr.unknownConf);
 }
 
 // Classify conflicts into cardinal, semi-cardinal and non-cardinal and populate the node's conflict lists with them
 // Returns the highest priority conflict.
 // If a CBS heuristic isn't used, return the first cardinal conflict that was found immediately, without finishing
 // the classification of conflicts.
-std::shared_ptr<Conflict> ICBSSearch::classifyConflicts(ICBSNode &node, vector<vector<PathEntry> *> &the_paths)
+ConflictId ICBSSearch::classifyConflicts(ICBSNode &node, vector<vector<PathEntry> *> &the_paths)
 {
 	if (node.cardinalConf.empty() && node.semiConf.empty() && node.nonConf.empty() && node.unknownConf.empty())
-		return NULL; // No conflict
+		return NO_CONFLICT; // No conflict
 
 	// Classify all conflicts in unknownConf
-	while (!node.unknownConf.empty())
+	for (size_t i = 0; i < node.unknownConf.size(); i++)
 	{
-		std::shared_ptr<Conflict> con = node.unknownConf.front();
-		auto [agent1, agent2, loc1, loc2, timestep] = *con;
-		node.unknownConf.pop_front();
+		ConflictId con = node.unknownConf[i];
+		auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[con];
+		if (node.isMerged(agent1) || node.isMerged(agent2))
+		{  // The members of a meta-agent aren't each planned optimally, so their MDDs don't show if a cost must rise
+			node.nonConf.push_back(con);
+			continue;
+		}
 
 		bool cardinal1, cardinal2;
 		if (loc2 >= 0) // Edge conflict
@@ -487,11 +822,55 @@ std::shared_ptr<Conflict> ICBSSearch::classifyConflicts(ICBSNode &node, vector<v
 				buildMDD(node, the_paths, agent2, timestep);
 				cardinal2 = the_paths[agent2]->at(timestep).single;
 			}
+			ConflictId target = target_reasoning ?
+			                    findTargetConflict(node, the_paths, agent1, agent2, loc1, timestep) : NO_CONFLICT;
+			if (target != NO_CONFLICT)  // Split the target conflict instead - it's just as cardinal
+				con = target;
+			else if (rectangle_reasoning)
+			{
+				bool rectangle_cardinal1, rectangle_cardinal2;
+				ConflictId rectangle = findRectangleConflict(node, the_paths, agent1, agent2, timestep,
+				                                             rectangle_cardinal1, rectangle_cardinal2);
+				if (rectangle != NO_CONFLICT &&  // Split the rectangle instead, unless the conflict is more cardinal
+				    rectangle_cardinal1 + rectangle_cardinal2 >= cardinal1 + cardinal2)
+				{
+					con = rectangle;
+					cardinal1 = rectangle_cardinal1;
+					cardinal2 = rectangle_cardinal2;
+				}
+			}
+		}
+		if (corridor_reasoning && !isRectangleConflict(conflict_pool[con]) && !isTargetConflict(conflict_pool[con]))
+		{
+			bool corridor_cardinal1, corridor_cardinal2;
+			ConflictId corridor = findCorridorConflict(node, the_paths, agent1, agent2, loc1, loc2, timestep,
+			                                           corridor_cardinal1, corridor_cardinal2);
+			if (corridor != NO_CONFLICT &&  // Split the corridor instead, unless the conflict is more cardinal
+			    corridor_cardinal1 + corridor_cardinal2 >= cardinal1 + cardinal2)
+			{
+				con = corridor;
+				cardinal1 = corridor_cardinal1;
+				cardinal2 = corridor_cardinal2;
+			}
+		}
+		if (mutex_reasoning && !(cardinal1 && cardinal2))
+		{
+			bool mutex_cardinal;
+			ConflictId mutex = findMutexConflict(node, the_paths, agent1, agent2, timestep, mutex_cardinal);
+			if (mutex_cardinal)
+			{
+				num_mutex_cardinal++;
+				if (mutex != NO_CONFLICT)  // Split on the mutex level instead - it raises the costs of both agents
+					con = mutex;
+				cardinal1 = true;
+				cardinal2 = true;
+			}
 		}
 		if (cardinal1 && cardinal2)
 		{
 			if (!HL_heuristic)  // Found a cardinal conflict and they're not used to complete heuristics. Return it immediately.
 			{
+				node.unknownConf.erase(node.unknownConf.begin(), node.unknownConf.begin() + i + 1);
 				conflictType = conflict_type::CARDINAL;
 				return con;
 			}
@@ -510,101 +889,498 @@ std::shared_ptr<Conflict> ICBSSearch::classifyConflicts(ICBSNode &node, vector<v
 			node.nonConf.push_back(con);
 		}
 	}
+	node.unknownConf.clear();
 
 	return getHighestPriorityConflict(node, the_paths);
 }
 
-// Primary priority - cardinal conflicts, then semi-cardinal and non-cardinal conflicts
-std::shared_ptr<Conflict> ICBSSearch::getHighestPriorityConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths)
+// Rectangle reasoning: two agents that move Manhattan-optimally from their starts, one entering the rectangle between
+// their starts and goals from its top and the other from its side, reach every cell of the rectangle at the same time.
+// Splitting on one of their vertex conflicts would only move the conflict to another cell of the rectangle. Instead,
+// the rectangle's first agent gets a barrier on the rectangle's far row and its second agent one on its far column:
+// paths that cross both on time always meet, so every solution satisfies at least one of the barriers.
+// The goal side of the rectangle is the farthest point each agent's path stays Manhattan-optimal to, preferring
+// singletons of its MDD. A barrier blocks all the agent's paths of its current cost if pruning it from the agent's
+// MDD leaves no path.
+// Returns the rectangle conflict, or NO_CONFLICT if there isn't one or the current paths don't cross its barriers.
+// Sets cardinal1 and cardinal2 to whether the barriers raise the costs of the rectangle conflict's first and second
+// agents.
+ConflictId ICBSSearch::findRectangleConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2,
+                                             int timestep, bool &cardinal1, bool &cardinal2)
 {
-	vector<int> metric(num_of_agents, 0);
-	vector<double> widthMDD(num_of_agents, 0);
-	if (split == split_strategy::SINGLETONS)
+	if (hasPositiveConstraints(&node, a1) || hasPositiveConstraints(&node, a2))
+		return NO_CONFLICT;  // Replanning an agent with landmarks only replans the segment around one timestep
+	int agents[2] = {a1, a2};
+	int sx[2], sy[2], gx[2], gy[2];
+	bool goal_single[2];
+	for (int i = 0; i < 2; i++)
 	{
-		for (int i = 0; i < num_of_agents; i++)
+		const vector<PathEntry>& path = *the_paths[agents[i]];
+		int start = search_engines[agents[i]]->start_location;
+		sx[i] = start % num_map_cols;
+		sy[i] = start / num_map_cols;
+		auto distance = [&](int loc) { return abs(loc % num_map_cols - sx[i]) + abs(loc / num_map_cols - sy[i]); };
+		if (timestep >= (int)path.size() || distance(path[timestep].location) != timestep)
+			return NO_CONFLICT;  // The agent didn't get to the conflict Manhattan-optimally
+		buildMDD(node, the_paths, agents[i], timestep);
+		int goal_timestep = timestep;
+		int single_timestep = -1;
+		for (int t = timestep; t < (int)path.size() && distance(path[t].location) == t; t++)
 		{
-			for (int j = 0; j< the_paths[i]->size(); j++)
-				widthMDD[i] += the_paths[i]->at(j).numMDDNodes;
-			widthMDD[i] /= the_paths[i]->size();
+			goal_timestep = t;
+			if (path[t].builtMDD && path[t].single)
+				single_timestep = t;
 		}
+		goal_single[i] = single_timestep >= 0;
+		if (goal_single[i])
+			goal_timestep = single_timestep;
+		gx[i] = path[goal_timestep].location % num_map_cols;
+		gy[i] = path[goal_timestep].location / num_map_cols;
 	}
-	if (!node.cardinalConf.empty())
-	{
-		conflictType = conflict_type::CARDINAL;
-		return getHighestPriorityConflict(node.cardinalConf, the_paths, widthMDD, metric);
-	}
-	else if (!node.semiConf.empty())
+
+	// Flip the axes so both agents move towards larger coordinates
+	auto sign = [](int v) { return (v > 0) - (v < 0); };
+	int dx1 = sign(gx[0] - sx[0]), dx2 = sign(gx[1] - sx[1]);
+	int dy1 = sign(gy[0] - sy[0]), dy2 = sign(gy[1] - sy[1]);
+	if (dx1 * dx2 < 0 || dy1 * dy2 < 0)
+		return NO_CONFLICT;  // The agents move in opposite directions
+	int dx = dx1 != 0 ? dx1 : dx2;
+	int dy = dy1 != 0 ? dy1 : dy2;
+	if (dx == 0 || dy == 0)
+		return NO_CONFLICT;  // Both agents move along the same line
+	int rs_x = max(dx * sx[0], dx * sx[1]), rs_y = max(dy * sy[0], dy * sy[1]);
+	int rg_x = min(dx * gx[0], dx * gx[1]), rg_y = min(dy * gy[0], dy * gy[1]);
+	if (rs_x > rg_x || rs_y > rg_y || (rs_x == rg_x && rs_y == rg_y))
+		return NO_CONFLICT;  // No rectangle, or just the conflicting cell
+
+	// Both agents reach the conflict on time, so they're equally far from Rs. The one whose start is farther along x
+	// enters the rectangle from its top, so it's the one that crosses the far row.
+	int row_agent = dx * sx[0] > dx * sx[1] ? 0 : 1;
+	int column_agent = 1 - row_agent;
+	Conflict rectangle = make_tuple(agents[row_agent], agents[column_agent],
+	                                dy * rs_y * num_map_cols + dx * rs_x,
+	                                -2 - (dy * rg_y * num_map_cols + dx * rg_x), timestep);
+
+	// Each barrier must block the current path of its agent, or its child would have the same paths
+	vector<Constraint> barriers[2];
+	for (int i : {row_agent, column_agent})
 	{
-		conflictType = conflict_type::SEMICARDINAL;
-		return getHighestPriorityConflict(node.semiConf, the_paths, widthMDD, metric);
+		const vector<PathEntry>& path = *the_paths[agents[i]];
+		getRectangleBarrier(rectangle, agents[i], barriers[i]);
+		if (std::none_of(barriers[i].begin(), barriers[i].end(), [&](const Constraint& con) {
+			    return std::get<2>(con) < (int)path.size() && path[std::get<2>(con)].location == std::get<0>(con);
+		    }))
+			return NO_CONFLICT;
 	}
-	else
+	bool cardinal[2];
+	for (int i : {row_agent, column_agent})
 	{
-		conflictType = conflict_type::NONCARDINAL;
-		return getHighestPriorityConflict(node.nonConf, the_paths, widthMDD, metric);
+		pair<int, int> start = make_pair(search_engines[agents[i]]->start_location, 0);
+		pair<int, int> goal = make_pair(search_engines[agents[i]]->goal_location,
+		                                (int)the_paths[agents[i]]->size() - 1);
+		MDD pruned(*getMDD(lastNodeThatReplanned(node, agents[i]), the_paths, agents[i], 0, 0, start, goal));
+		cardinal[i] = !pruned.updateMDD(barriers[i], start.second);
 	}
-
+	cardinal1 = cardinal[row_agent];
+	cardinal2 = cardinal[column_agent];
+	return conflict_pool.intern(rectangle);
 }
 
-// Secondary priority within a primary priority group
-std::shared_ptr<Conflict> ICBSSearch::getHighestPriorityConflict(const list<std::shared_ptr<Conflict>> &confs,
-                                                                 vector<vector<PathEntry> *> &the_paths,
-                                                                 const vector<double> &widthMDD,
-                                                                 const vector<int> &metric)
+// The barrier of an agent of a rectangle conflict: negative vertex constraints on the cells of the rectangle's far
+// row for its first agent, or of its far column for its second agent, each at the time the agent would reach the
+// cell Manhattan-optimally. Obstacles are left out.
+void ICBSSearch::getRectangleBarrier(const Conflict &conflict, int ag, vector<Constraint> &barrier) const
 {
-	std::shared_ptr<Conflict> choice = confs.front();
-
-	if (split == split_strategy::SINGLETONS)
+	auto [agent1, agent2, rs, minus_two_minus_rg, conflict_timestep] = conflict;
+	int rg = -2 - minus_two_minus_rg;
+	int rs_x = rs % num_map_cols, rs_y = rs / num_map_cols;
+	int rg_x = rg % num_map_cols, rg_y = rg / num_map_cols;
+	int dx = rg_x > rs_x ? 1 : -1;
+	int dy = rg_y > rs_y ? 1 : -1;
+	int start = search_engines[ag]->start_location;
+	int rs_timestep = abs(rs_x - start % num_map_cols) + abs(rs_y - start / num_map_cols);
+	barrier.clear();
+	if (ag == agent1)  // The far row
 	{
-		for (const auto& conf : confs)
+		int timestep = rs_timestep + abs(rg_y - rs_y);
+		for (int x = rs_x; ; x += dx, timestep++)
 		{
-			auto [agent1, agent2, loc1, loc2, timestep] = *conf;
-			auto [choice_agent1, choice_agent2, choice_loc1, choice_loc2, choice_timestep] = *choice;
-			int metric1 = 0;
-			int maxSingles = 0;
-			double minWidth = 0;
-			if (timestep < (int)the_paths[agent1]->size())
-				for (int j = 0; j < timestep; j++)
-					if (the_paths[agent1]->at(j).builtMDD && the_paths[agent1]->at(j).single)
-						metric1++;
-			int metric2 = 0;
-			if (timestep < (int)the_paths[agent2]->size())
-				for (int j = 0; j < timestep; j++)
-					if (the_paths[agent2]->at(j).builtMDD && the_paths[agent2]->at(j).single)
-						metric2++;
-			if (max(metric1, metric2) > metric[0])
-			{
-				choice = conf;
-				maxSingles = max(metric1, metric2);
-				minWidth = min(widthMDD[agent1], widthMDD[agent2]);
-			}
-			else if (max(metric1, metric2) == maxSingles &&  min(widthMDD[agent1], widthMDD[agent2]) < minWidth)
-			{
-				choice = conf;
-				minWidth = min(widthMDD[agent1], widthMDD[agent2]);
-			}
+			int loc = rg_y * num_map_cols + x;
+			if (!search_engines[ag]->my_map[loc])
+				barrier.emplace_back(loc, -1, timestep, false);
+			if (x == rg_x)
+				break;
 		}
 	}
-	else if (split == split_strategy::WIDTH)
+	else  // The far column
 	{
-		for (const auto& conf : confs)
+		int timestep = rs_timestep + abs(rg_x - rs_x);
+		for (int y = rs_y; ; y += dy, timestep++)
 		{
-			auto [agent1, agent2, loc1, loc2, timestep] = *conf;
-			auto [choice_agent1, choice_agent2, choice_loc1, choice_loc2, choice_timestep] = *choice;
-			int w1, w2, w3, w4;
-			if (the_paths[agent1]->size() <= timestep)
-				w1 = 1;
-			else
+			int loc = y * num_map_cols + rg_x;
+			if (!search_engines[ag]->my_map[loc])
+				barrier.emplace_back(loc, -1, timestep, false);
+			if (y == rg_y)
+				break;
+		}
+	}
+}
+
+// Corridor reasoning: two agents that cross a corridor in opposite directions can't both cross it early, and
+// splitting on one of their conflicts in it would only delay one of them by a single timestep. Instead, each child
+// keeps one of the agents out of the entrance it leaves the corridor by until the other agent could have crossed the
+// corridor after it, or until it could have gone around the corridor (getCorridorConstraint).
+// The conflict must be inside the corridor, and neither agent may start, end or turn back in it.
+// Returns the corridor conflict, or NO_CONFLICT if there isn't one or the current paths don't violate its range
+// constraints. Sets cardinal1 and cardinal2 to whether the range constraints raise the costs of the agents.
+ConflictId ICBSSearch::findCorridorConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2,
+                                            int loc1, int loc2, int timestep, bool &cardinal1, bool &cardinal2)
+{
+	if (hasPositiveConstraints(&node, a1) || hasPositiveConstraints(&node, a2))
+		return NO_CONFLICT;  // Replanning an agent with landmarks only replans the segment around one timestep
+	// The corridor, and when each agent is in it. In an edge conflict, agent1 moves from loc1 to loc2.
+	int corridor;
+	int inside_timesteps[2];
+	if (loc2 < 0)
+	{
+		corridor = corridor_of[loc1];
+		inside_timesteps[0] = inside_timesteps[1] = timestep;
+	}
+	else if (corridor_of[loc2] >= 0)
+	{
+		corridor = corridor_of[loc2];
+		inside_timesteps[0] = timestep;
+		inside_timesteps[1] = timestep - 1;
+	}
+	else
+	{
+		corridor = corridor_of[loc1];
+		inside_timesteps[0] = timestep - 1;
+		inside_timesteps[1] = timestep;
+	}
+	if (corridor < 0)
+		return NO_CONFLICT;
+
+	// Where each agent enters and leaves the corridor
+	int agents[2] = {a1, a2};
+	int entrances[2], exits[2], exit_timesteps[2];
+	for (int i = 0; i < 2; i++)
+	{
+		const vector<PathEntry>& path = *the_paths[agents[i]];
+		int first = inside_timesteps[i], last = inside_timesteps[i];
+		if (last >= (int)path.size())
+			return NO_CONFLICT;  // The agent waits at its goal in the corridor
+		while (first >= 0 && corridor_of[path[first].location] == corridor)
+			first--;
+		while (last < (int)path.size() && corridor_of[path[last].location] == corridor)
+			last++;
+		if (first < 0 || last == (int)path.size())
+			return NO_CONFLICT;  // The agent starts or ends in the corridor
+		entrances[i] = path[first].location;
+		exits[i] = path[last].location;
+		exit_timesteps[i] = last;
+		if (entrances[i] == exits[i])
+			return NO_CONFLICT;  // The agent turns back
+	}
+	if (exits[0] != entrances[1])
+		return NO_CONFLICT;  // The agents cross the corridor in the same direction
+
+	Conflict corridor_conflict = make_tuple(a1, a2, -2 - corridor, exits[0], timestep);
+	bool cardinal[2];
+	for (int i = 0; i < 2; i++)
+	{
+		// The range constraint must block the current path of its agent, or its child would have the same paths
+		Constraint range = getCorridorConstraint(corridor_conflict, agents[i]);
+		if (exit_timesteps[i] < std::get<2>(range) || exit_timesteps[i] > rangeEnd(range))
+			return NO_CONFLICT;
+		buildMDD(node, the_paths, agents[i], exit_timesteps[i]);
+		cardinal[i] = the_paths[agents[i]]->at(exit_timesteps[i]).single;
+	}
+	cardinal1 = cardinal[0];
+	cardinal2 = cardinal[1];
+	return conflict_pool.intern(corridor_conflict);
+}
+
+// The range constraint of an agent of a corridor conflict: it may not be at the entrance it leaves the corridor by
+// from the earliest time it could get there until the time the other agent could get through the corridor after it,
+// or the time before it could get there around the corridor, whichever is earlier. Paths that get through the corridor
+// within both ranges always meet in it, so every solution satisfies at least one of the constraints.
+Constraint ICBSSearch::getCorridorConstraint(const Conflict &conflict, int ag)
+{
+	auto [agent1, agent2, minus_two_minus_corridor, exit1, conflict_timestep] = conflict;
+	int corridor = -2 - minus_two_minus_corridor;
+	const MapLoader::Corridor& c = corridors[corridor];
+	int exit2 = exit1 == c.entrance1 ? c.entrance2 : c.entrance1;
+	int other = ag == agent1 ? agent2 : agent1;
+	int exit = ag == agent1 ? exit1 : exit2;
+	int other_exit = ag == agent1 ? exit2 : exit1;
+	int first_timestep = max(1, distanceFromStart(ag, exit));
+	int last_timestep = min(bypassDistanceFromStart(ag, corridor, exit) - 1,
+	                        distanceFromStart(other, other_exit) + c.length);
+	return make_tuple(exit, -2 - last_timestep, first_timestep, false);
+}
+
+int ICBSSearch::distanceFromStart(int ag, int loc)
+{
+	if (start_distances.empty())
+		start_distances.resize(num_of_agents);
+	if (start_distances[ag].empty())
+		distancesFrom(search_engines[ag]->start_location, -1, start_distances[ag]);
+	return start_distances[ag][loc];
+}
+
+// The distance from the start of the agent to the given entrance of the corridor without going through it
+int ICBSSearch::bypassDistanceFromStart(int ag, int corridor, int entrance)
+{
+	int64_t key = (int64_t)ag * (int64_t)corridors.size() + corridor;
+	auto it = bypass_distances.find(key);
+	if (it == bypass_distances.end())
+	{
+		vector<int> distances;
+		distancesFrom(search_engines[ag]->start_location, corridor, distances);
+		it = bypass_distances.emplace(key, make_pair(distances[corridors[corridor].entrance1],
+		                                             distances[corridors[corridor].entrance2])).first;
+	}
+	return entrance == corridors[corridor].entrance1 ? it->second.first : it->second.second;
+}
+
+// Breadth-first search from the given location over the free cells outside the given corridor (-1 for none).
+// Unreachable cells are INT_MAX away.
+void ICBSSearch::distancesFrom(int loc, int blocked_corridor, vector<int> &distances) const
+{
+	const bool* my_map = search_engines[0]->my_map;
+	distances.assign(map_size, INT_MAX);
+	distances[loc] = 0;
+	std::queue<int> queue;
+	queue.push(loc);
+	while (!queue.empty())
+	{
+		int curr = queue.front();
+		queue.pop();
+		for (int direction = 0; direction < MapLoader::valid_moves_t::WAIT_MOVE; direction++)
+		{
+			int next = curr + moves_offset[direction];
+			if (next < 0 || next >= map_size || abs(next % num_map_cols - curr % num_map_cols) >= 2 || my_map[next] ||
+			    (blocked_corridor >= 0 && corridor_of[next] == blocked_corridor) || distances[next] != INT_MAX)
+				continue;
+			distances[next] = distances[curr] + 1;
+			queue.push(next);
+		}
+	}
+}
+
+// Target reasoning: once an agent reached its goal it stays there, so splitting on a conflict of another agent with it
+// there would only push the first agent out of its goal one timestep later in each descendant. Instead, one child
+// forbids the path of the first agent to end by the time of the conflict (a length constraint), and the other keeps
+// the second agent out of the goal from then on (getTargetConstraint). Every solution satisfies one of them: if the
+// path of the first agent ends by then, it's at its goal from then on.
+// The second agent is only kept out of the goal if its own goal stays connected to the rest of its part of the map
+// without the cells it's kept out of forever. Otherwise it might have no path, and the low level searches would keep
+// waiting for the constraints to end.
+// Returns the target conflict, or NO_CONFLICT if the vertex conflict at the location and timestep isn't one.
+ConflictId ICBSSearch::findTargetConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2,
+                                          int loc, int timestep)
+{
+	if (hasPositiveConstraints(&node, a1) || hasPositiveConstraints(&node, a2))
+		return NO_CONFLICT;  // Replanning an agent with landmarks only replans the segment around one timestep
+	for (auto [agent, other] : {make_pair(a1, a2), make_pair(a2, a1)})
+	{
+		if (loc != search_engines[agent]->goal_location || timestep < (int)the_paths[agent]->size() - 1)
+			continue;
+		vector<int> blocked = {loc};
+		for (const ICBSNode* curr = &node; curr != nullptr; curr = curr->parent)
+		{
+			for (const auto& [ag, con] : curr->constraints)
+			{
+				if (ag == other && !std::get<3>(con) && isRangeConstraint(con) && rangeEnd(con) == FOREVER)
+					blocked.push_back(std::get<0>(con));
+			}
+		}
+		if (!goalStaysConnected(search_engines[other]->goal_location, blocked))
+			return NO_CONFLICT;
+		return conflict_pool.intern(make_tuple(agent, other, -1, loc, timestep));
+	}
+	return NO_CONFLICT;
+}
+
+// The constraint of an agent of a target conflict: the agent that reached its goal may not end its path by the time of
+// the conflict, and the other agent may not be at that goal from then on
+Constraint ICBSSearch::getTargetConstraint(const Conflict &conflict, int ag) const
+{
+	auto [agent1, agent2, minus_one, goal, timestep] = conflict;
+	if (ag == agent1)
+		return make_tuple(-1, goal, timestep, false);
+	return make_tuple(goal, -2 - FOREVER, timestep, false);
+}
+
+// Whether every cell of the part of the map the goal is in, other than the blocked cells, can still get to the goal
+// without going through them
+bool ICBSSearch::goalStaysConnected(int goal, vector<int> blocked)
+{
+	std::sort(blocked.begin(), blocked.end());
+	vector<int> key(blocked);
+	key.push_back(goal);
+	auto it = goal_connectivity.find(key);
+	if (it != goal_connectivity.end())
+		return it->second;
+
+	const bool* my_map = search_engines[0]->my_map;
+	vector<bool> is_blocked(map_size, false);
+	for (int loc : blocked)
+		is_blocked[loc] = true;
+	// Counts the unblocked cells reachable from the goal, going through the blocked cells or not
+	auto countReachable = [&](bool through_blocked) {
+		vector<bool> reached(map_size, false);
+		reached[goal] = true;
+		std::queue<int> queue;
+		queue.push(goal);
+		int count = 0;
+		while (!queue.empty())
+		{
+			int curr = queue.front();
+			queue.pop();
+			if (!is_blocked[curr])
+				count++;
+			for (int direction = 0; direction < MapLoader::valid_moves_t::WAIT_MOVE; direction++)
+			{
+				int next = curr + moves_offset[direction];
+				if (next < 0 || next >= map_size || abs(next % num_map_cols - curr % num_map_cols) >= 2 ||
+				    my_map[next] || reached[next] || (!through_blocked && is_blocked[next]))
+					continue;
+				reached[next] = true;
+				queue.push(next);
+			}
+		}
+		return count;
+	};
+	bool connected = countReachable(false) == countReachable(true);
+	goal_connectivity[key] = connected;
+	return connected;
+}
+
+// Mutex reasoning: the singletons of each agent's MDD miss conflicts whose agents can each keep their cost, just not
+// both of them. Propagating mutexes on the pair of the agents' MDDs (MutexPropagation) finds them: if the goals are
+// mutex, the cost of one of the agents must increase, so the conflict is cardinal for the heuristics. If a level of the
+// MDDs up to the shorter one's goal has all its pairs of nodes mutex, each agent gets negative vertex constraints on all
+// its nodes at the level with the fewest of them. Every solution satisfies one of the sets, and each set blocks all the
+// paths of its agent's current cost.
+// Returns the mutex conflict, or NO_CONFLICT if the goals aren't mutex or no level has all its pairs mutex.
+// Sets cardinal to whether the goals are mutex.
+ConflictId ICBSSearch::findMutexConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2,
+                                         int timestep, bool &cardinal)
+{
+	cardinal = false;
+	if (hasPositiveConstraints(&node, a1) || hasPositiveConstraints(&node, a2))
+		return NO_CONFLICT;  // The MDDs of agents with landmarks only span the segment between two of them
+	std::shared_ptr<const MDD> mdds[2];
+	int agents[2] = {a1, a2};
+	for (int i = 0; i < 2; i++)
+	{
+		pair<int, int> start = make_pair(search_engines[agents[i]]->start_location, 0);
+		pair<int, int> goal = make_pair(search_engines[agents[i]]->goal_location,
+		                                (int)the_paths[agents[i]]->size() - 1);
+		mdds[i] = getMDD(lastNodeThatReplanned(node, agents[i]), the_paths, agents[i], 0, 0, start, goal);
+	}
+	MutexPropagation mutexes(*mdds[0], *mdds[1]);
+	cardinal = mutexes.propagate();
+	if (!cardinal)
+		return NO_CONFLICT;
+	vector<Constraint> constraints1, constraints2;
+	if (!mutexes.getSymmetricConstraints(constraints1, constraints2))
+		return NO_CONFLICT;
+	return conflict_pool.internMutex(a1, a2, timestep, constraints1, constraints2);
+}
+
+// Primary priority - cardinal conflicts, then semi-cardinal and non-cardinal conflicts
+ConflictId ICBSSearch::getHighestPriorityConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths)
+{
+	vector<int> metric(num_of_agents, 0);
+	vector<double> widthMDD(num_of_agents, 0);
+	if (split == split_strategy::SINGLETONS)
+	{
+		for (int i = 0; i < num_of_agents; i++)
+		{
+			for (int j = 0; j< the_paths[i]->size(); j++)
+				widthMDD[i] += the_paths[i]->at(j).numMDDNodes;
+			widthMDD[i] /= the_paths[i]->size();
+		}
+	}
+	if (!node.cardinalConf.empty())
+	{
+		conflictType = conflict_type::CARDINAL;
+		return getHighestPriorityConflict(node.cardinalConf, the_paths, widthMDD, metric);
+	}
+	else if (!node.semiConf.empty())
+	{
+		conflictType = conflict_type::SEMICARDINAL;
+		return getHighestPriorityConflict(node.semiConf, the_paths, widthMDD, metric);
+	}
+	else
+	{
+		conflictType = conflict_type::NONCARDINAL;
+		return getHighestPriorityConflict(node.nonConf, the_paths, widthMDD, metric);
+	}
+
+}
+
+// Secondary priority within a primary priority group
+ConflictId ICBSSearch::getHighestPriorityConflict(const vector<ConflictId> &confs,
+                                                  vector<vector<PathEntry> *> &the_paths,
+                                                  const vector<double> &widthMDD,
+                                                  const vector<int> &metric)
+{
+	ConflictId choice = confs.front();
+
+	if (split == split_strategy::SINGLETONS)
+	{
+		for (const auto& conf : confs)
+		{
+			auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[conf];
+			int metric1 = 0;
+			int maxSingles = 0;
+			double minWidth = 0;
+			if (timestep < (int)the_paths[agent1]->size())
+				for (int j = 0; j < timestep; j++)
+					if (the_paths[agent1]->at(j).builtMDD && the_paths[agent1]->at(j).single)
+						metric1++;
+			int metric2 = 0;
+			if (timestep < (int)the_paths[agent2]->size())
+				for (int j = 0; j < timestep; j++)
+					if (the_paths[agent2]->at(j).builtMDD && the_paths[agent2]->at(j).single)
+						metric2++;
+			if (max(metric1, metric2) > metric[0])
+			{
+				choice = conf;
+				maxSingles = max(metric1, metric2);
+				minWidth = min(widthMDD[agent1], widthMDD[agent2]);
+			}
+			else if (max(metric1, metric2) == maxSingles &&  min(widthMDD[agent1], widthMDD[agent2]) < minWidth)
+			{
+				choice = conf;
+				minWidth = min(widthMDD[agent1], widthMDD[agent2]);
+			}
+		}
+	}
+	else if (split == split_strategy::WIDTH)
+	{
+		for (const auto& conf : confs)
+		{
+			auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[conf];
+			auto [choice_agent1, choice_agent2, choice_loc1, choice_loc2, choice_timestep] = conflict_pool[choice];
+			int w1, w2, w3, w4;
+			if ((int)the_paths[agent1]->size() <= timestep)
+				w1 = 1;
+			else
 				w1 = the_paths[agent1]->at(timestep).numMDDNodes;
-			if (the_paths[agent2]->size() <= timestep)
+			if ((int)the_paths[agent2]->size() <= timestep)
 				w2 = 1;
 			else
 				w2 = the_paths[agent2]->at(timestep).numMDDNodes;
-			if (the_paths[choice_agent1]->size() <= choice_timestep)
+			if ((int)the_paths[choice_agent1]->size() <= choice_timestep)
 				w3 = 1;
 			else
 				w3 = the_paths[choice_agent1]->at(choice_timestep).numMDDNodes;
-			if (the_paths[choice_agent2]->size() <= choice_timestep)
+			if ((int)the_paths[choice_agent2]->size() <= choice_timestep)
 				w4 = 1;
 			else
 				w4 = the_paths[choice_agent2]->at(choice_timestep).numMDDNodes;
@@ -640,15 +1416,7 @@ std::shared_ptr<Conflict> ICBSSearch::getHighestPriorityConflict(const list<std:
 #if !defined(LPA) && !defined(NOLPA_LATEST_CONFLICT_WITHIN_CLASS)
 	else // uniformly at random
 	{
-		int id = rand() % confs.size();
-		int i = 0;
-		for (list<std::shared_ptr<Conflict>>::const_iterator it = confs.begin(); it != confs.end(); ++it)
-		{
-			if (i == id)
-				return *it;
-			else
-				i++;
-		}
+		return confs[rand() % confs.size()];
 	}
 #else
 	else // Closer to the goal - better for LPA*
@@ -658,7 +1426,7 @@ std::shared_ptr<Conflict> ICBSSearch::getHighestPriorityConflict(const list<std:
 		int min_steps_from_goal = std::numeric_limits<int>::max();
 		for (const auto& conf : confs)
 		{
-			auto [agent1, agent2, loc1, loc2, timestep] = *conf;
+			auto [agent1, agent2, loc1, loc2, timestep] = conflict_pool[conf];
 			int steps_from_goal = the_paths[agent1]->size() - 1 - timestep + the_paths[agent2]->size() - 1 - timestep;
 			if (steps_from_goal < min_steps_from_goal) {
 				choice = conf;
@@ -680,7 +1448,80 @@ void ICBSSearch::buildMDD(ICBSNode &curr, vector<vector<PathEntry> *> &the_paths
 	if (the_paths[ag]->at(timestep).builtMDD)
 		return;
 
-	// Find the last node on this branch that computed a new path for this agent
+	ICBSNode* node = lastNodeThatReplanned(curr, ag);
+
+	// Build a constraint table with entries for each timestep up to the makespan at the last node that added a
+	// constraint for the agent. There can't be constraints that occur later than that because each agent must plan a
+	// path that at least lets every constraint have the opportunity to affect it.
+	pair<int, int> start = make_pair(search_engines[ag]->start_location, 0);
+	pair<int, int> goal = make_pair(search_engines[ag]->goal_location, (int)the_paths[ag]->size() - 1);
+
+#ifdef LPA
+	// The agent's LPA* instance already knows the g-values of all the nodes of its MDD, unless the agent has positive
+	// constraints, which LPA* doesn't support, or the instance wasn't searched since its constraints last changed
+	if (lookahead == 0 && curr.lpas[ag] != nullptr && !hasPositiveConstraints(node, ag))
+	{
+		std::clock_t mdd_building_start = std::clock();
+		auto wall_mddStart = std::chrono::system_clock::now();
+		vector<int> widths;
+		bool extracted = curr.lpas[ag]->getMDDWidths(widths) && widths.size() == the_paths[ag]->size();
+		highLevelMddBuildingTime += std::clock() - mdd_building_start;
+		wall_mddTime += std::chrono::system_clock::now() - wall_mddStart;
+		if (extracted)
+		{
+			mdd_num_from_lpa++;
+			for (int i = 0; i < (int)widths.size(); i++)
+			{
+				the_paths[ag]->at(i).single = widths[i] == 1;
+				the_paths[ag]->at(i).numMDDNodes = widths[i];
+				the_paths[ag]->at(i).builtMDD = true;
+			}
+			return;
+		}
+	}
+#endif
+
+	// Only the levels around the timestep matter for classifying the conflict, unless the split strategy needs the
+	// widths of all the levels
+	if (mdd_window > 0 && lookahead == 0 && split != split_strategy::WIDTH && split != split_strategy::SINGLETONS)
+	{
+		std::clock_t mdd_building_start = std::clock();
+		auto wall_mddStart = std::chrono::system_clock::now();
+		std::vector < std::unordered_map<int, ConstraintState > > cons_table(node->makespan + 1);
+		buildConstraintTable(node, ag, timestep, cons_table, start, goal);
+		int first_timestep = std::max(start.second, timestep - mdd_window);
+		int last_timestep = std::min(goal.second, timestep + mdd_window);
+		vector<int> widths;
+		MDD::buildWindowWidths(cons_table, start, goal, first_timestep, last_timestep, *search_engines[ag], widths);
+		// The widths are upper bounds, so only the narrow levels are known. The other levels are left unknown, like
+		// levels with no MDD - a wide level is taken to mean the cost can't increase.
+		bool whole_mdd = first_timestep == start.second && last_timestep == goal.second;
+		for (int i = 0; i < (int)widths.size(); i++)
+		{
+			if (widths[i] != 1 && !whole_mdd)
+				continue;
+			the_paths[ag]->at(i + first_timestep).single = widths[i] == 1;
+			the_paths[ag]->at(i + first_timestep).numMDDNodes = widths[i];
+			the_paths[ag]->at(i + first_timestep).builtMDD = true;
+		}
+		highLevelMddBuildingTime += std::clock() - mdd_building_start;
+		wall_mddTime += std::chrono::system_clock::now() - wall_mddStart;
+		mdd_num_windowed++;
+		return;
+	}
+
+	std::shared_ptr<const MDD> mdd = getMDD(node, the_paths, ag, timestep, lookahead, start, goal);
+	for (int i = 0; i < mdd->numLevels(); i++)
+	{
+		the_paths[ag]->at(i + start.second).single = mdd->width(i) == 1;
+		the_paths[ag]->at(i + start.second).numMDDNodes = mdd->width(i);
+		the_paths[ag]->at(i + start.second).builtMDD = true;
+	}
+}
+
+// Find the last node on this branch that computed a new path for this agent
+ICBSNode* ICBSSearch::lastNodeThatReplanned(ICBSNode &curr, int ag) const
+{
 	ICBSNode* node = &curr; // Back to where we get the path
 	bool found = false;
 	while (node->parent != NULL)
@@ -698,27 +1539,126 @@ void ICBSSearch::buildMDD(ICBSNode &curr, vector<vector<PathEntry> *> &the_paths
 		else
 			node = node->parent;
 	}
+	return node;
+}
 
-	// Build a constraint table with entries for each timestep up to the makespan at the last node that added a
-	// constraint for the agent. There can't be constraints that occur later than that because each agent must plan a
-	// path that at least lets every constraint have the opportunity to affect it.
-	std::vector < std::unordered_map<int, ConstraintState > > cons_table(node->makespan + 1);
-	pair<int, int> start = make_pair(search_engines[ag]->start_location, 0);
-	pair<int, int> goal = make_pair(search_engines[ag]->goal_location, (int)the_paths[ag]->size() - 1);
-	buildConstraintTable(node, ag, timestep, cons_table, start, goal);
+// The MDD of the agent's current cost under the constraints of the branch up to the given node, the last one that
+// replanned the agent, from the cache or newly built. Sets start and goal to the first and last nodes of the MDD,
+// which only spans the agent's landmarks around the timestep if it was cached.
+std::shared_ptr<const MDD> ICBSSearch::getMDD(ICBSNode *node, vector<vector<PathEntry> *> &the_paths, int ag,
+                                              int timestep, int lookahead, pair<int, int>& start, pair<int, int>& goal)
+{
+	// Look for an MDD with the same start, goal and constraints in the cache
+	MDDCacheKey key;
+	std::shared_ptr<const MDD> mdd;
+	if (mdd_cache.max_bytes > 0)
+	{
+		narrowToLandmarks(node, ag, timestep, start, goal);
+		key = MDDCacheKey{ag, start.first, start.second, goal.first, goal.second, lookahead,
+		                  hashConstraintsOfAgent(node, ag)};
+		clock_t build_time;
+		mdd = mdd_cache.lookup(key, build_time);
+		if (mdd != nullptr)
+		{
+			mdd_cache_hits++;
+			mdd_cache_saved_time += build_time;
+		}
+		else
+			mdd_cache_misses++;
+	}
 
-	std::clock_t mdd_building_start = std::clock();
-	auto wall_mddStart = std::chrono::system_clock::now();
-	MDD mdd;
-	mdd.buildMDD(cons_table, start, goal, lookahead, *search_engines[ag]);
-	highLevelMddBuildingTime += std::clock() - mdd_building_start;
-	wall_mddTime = std::chrono::system_clock::now() - wall_mddStart;
+	if (mdd == nullptr)
+	{
+		std::clock_t mdd_building_start = std::clock();
+		auto wall_mddStart = std::chrono::system_clock::now();
+
+		// If the MDD of the agent with the same cost but without its last negative constraint, or without the whole run
+		// of them that ends with it (a barrier), is in the cache, prune them from a copy of it instead of building the
+		// MDD from scratch. When the constraints raised the cost there's no such MDD - the key includes the cost.
+		vector<Constraint> last_constraints;
+		node->lastNegativeConstraints(ag, last_constraints);
+		if (mdd_cache.max_bytes > 0 && !last_constraints.empty())
+		{
+			MDDCacheKey parent_key = key;
+			parent_key.constraints_hash.first -= hashConstraint(last_constraints.front(), 0);
+			parent_key.constraints_hash.second -= hashConstraint(last_constraints.front(), 0, check_seed);
+			clock_t parent_build_time;
+			std::shared_ptr<const MDD> parent_mdd = mdd_cache.lookup(parent_key, parent_build_time);
+			if (parent_mdd != nullptr)
+				last_constraints.resize(1);
+			else if (last_constraints.size() > 1)
+			{
+				for (int i = 1; i < (int)last_constraints.size(); i++)
+				{
+					parent_key.constraints_hash.first -= hashConstraint(last_constraints[i], 0);
+					parent_key.constraints_hash.second -= hashConstraint(last_constraints[i], 0, check_seed);
+				}
+				parent_mdd = mdd_cache.lookup(parent_key, parent_build_time);
+			}
+			if (parent_mdd != nullptr)
+			{
+				auto pruned = std::make_shared<MDD>(*parent_mdd);
+				if (pruned->updateMDD(last_constraints, start.second))
+				{
+					mdd = pruned;
+					mdd_num_incremental_updates++;
+				}
+			}
+		}
 
-	for (int i = 0; i < mdd.levels.size(); i++)
+		if (mdd == nullptr)
+		{
+			std::vector < std::unordered_map<int, ConstraintState > > cons_table(node->makespan + 1);
+			start = make_pair(search_engines[ag]->start_location, 0);
+			goal = make_pair(search_engines[ag]->goal_location, (int)the_paths[ag]->size() - 1);
+			buildConstraintTable(node, ag, timestep, cons_table, start, goal);
+			auto built = std::make_shared<MDD>();
+			built->buildMDD(cons_table, start, goal, lookahead, *search_engines[ag]);
+			mdd = built;
+		}
+		clock_t build_time = std::clock() - mdd_building_start;
+		highLevelMddBuildingTime += build_time;
+		wall_mddTime += std::chrono::system_clock::now() - wall_mddStart;
+		if (mdd_cache.max_bytes > 0)
+			mdd_cache.insert(key, mdd, build_time);
+	}
+	return mdd;
+}
+
+// Whether the agent has landmarks on the branch
+bool ICBSSearch::hasPositiveConstraints(const ICBSNode* curr, int agent_id) const
+{
+	for (; curr != nullptr; curr = curr->parent)
 	{
-		the_paths[ag]->at(i + start.second).single = mdd.levels[i].size() == 1;
-		the_paths[ag]->at(i + start.second).numMDDNodes = (int)mdd.levels[i].size();
-		the_paths[ag]->at(i + start.second).builtMDD = true;
+		for (const auto& [ag, con] : curr->constraints)
+		{
+			if (ag == agent_id && std::get<3>(con))
+				return true;
+		}
+	}
+	return false;
+}
+
+// Narrow the given start and goal of the agent to its latest landmark before the timestep and its earliest landmark
+// at or after it, like buildConstraintTable does, but without building a constraint table
+void ICBSSearch::narrowToLandmarks(const ICBSNode* curr, int agent_id, int timestep, pair<int, int>& start,
+                                   pair<int, int>& goal) const
+{
+	for (; curr != nullptr; curr = curr->parent)
+	{
+		for (const auto& [ag, con] : curr->constraints)
+		{
+			auto [loc1, loc2, constraint_timestep, positive_constraint] = con;
+			if (ag != agent_id || !positive_constraint)
+				continue;
+			if (loc2 < 0) // vertex constraint
+				applyLandmark(loc1, constraint_timestep, timestep, start, goal);
+			else // edge constraint, viewed as two landmarks on the from-vertex and the to-vertex
+			{
+				applyLandmark(loc1, constraint_timestep - 1, timestep, start, goal);
+				applyLandmark(loc2, constraint_timestep, timestep, start, goal);
+			}
+		}
 	}
 }
 
@@ -745,9 +1685,10 @@ int ICBSSearch::getTotalMddWidth(int agent_id)
 }
 
 void ICBSSearch::addPositiveConstraintsOnNarrowLevelsLeadingToPositiveConstraint(int agent_id, int timestep,
-		ICBSNode* n1, ICBSNode* n2, const std::vector < std::unordered_map<int, AvoidanceState > >* catp)
+		ICBSNode* n1, ICBSNode*, const std::vector < std::unordered_map<int, AvoidanceState > >* catp)
 {
-	if (posConstraintsAlsoAddPosConstraintsOnMddNarrowLevelsLeadingToThem)
+	// An agent that's at its goal at the timestep doesn't have to follow the MDD of its current cost to get there
+	if (posConstraintsAlsoAddPosConstraintsOnMddNarrowLevelsLeadingToThem && timestep < (int)paths[agent_id]->size())
 	// The MDD levels up to the positive constraint are a superset of the MDD levels of the MDD for reaching
 	// the location of the positive constraint at the time of the positive constraint, so any 1-width level
 	// among the levels up to that of the positive constraint is also a 1-width level in the MDD for the agent
@@ -782,10 +1723,57 @@ void ICBSSearch::addPositiveConstraintsOnNarrowLevelsLeadingToPositiveConstraint
 // add constraints to child nodes
 void ICBSSearch::branch(ICBSNode* curr, ICBSNode* n1, ICBSNode* n2)
 {
-	auto [agent1_id, agent2_id, location1, location2, timestep] = *curr->conflict;
+	auto [agent1_id, agent2_id, location1, location2, timestep] = conflict_pool[curr->conflict];
+
 
+	if (isRectangleConflict(conflict_pool[curr->conflict]) || isCorridorConflict(conflict_pool[curr->conflict]) ||
+	    isTargetConflict(conflict_pool[curr->conflict]) || isMutexConflict(conflict_pool[curr->conflict]))
+	{  // Each child gets the barrier, range, length or mutex constraints of one of the agents
+		n1->agent_id = agent1_id;
+		n2->agent_id = agent2_id;
 
-	if (split == split_strategy::RANDOM)  // A disjoint split that chooses the agent to work on randomly
+		std::vector<std::unordered_map<int, AvoidanceState>>* catp1 = nullptr;
+		std::vector<std::unordered_map<int, AvoidanceState>>* catp2 = nullptr;
+#ifndef LPA
+#else
+		// build conflict-avoidance tables for the agents we'll constrain
+		std::vector < std::unordered_map<int, AvoidanceState > > cat1(curr->makespan + 1);
+		std::vector < std::unordered_map<int, AvoidanceState > > cat2(curr->makespan + 1);
+		buildConflictAvoidanceTable(paths, agent1_id, *curr, cat1);
+		buildConflictAvoidanceTable(paths, agent2_id, *curr, cat2);
+		catp1 = &cat1;
+		catp2 = &cat2;
+#endif
+
+		if (isCorridorConflict(conflict_pool[curr->conflict]))
+		{
+			LL_num_generated += n1->add_constraint(getCorridorConstraint(conflict_pool[curr->conflict], agent1_id), catp1);
+			LL_num_generated += n2->add_constraint(getCorridorConstraint(conflict_pool[curr->conflict], agent2_id), catp2);
+			num_corridor_splits++;
+		}
+		else if (isTargetConflict(conflict_pool[curr->conflict]))
+		{
+			LL_num_generated += n1->add_constraint(getTargetConstraint(conflict_pool[curr->conflict], agent1_id), catp1);
+			LL_num_generated += n2->add_constraint(getTargetConstraint(conflict_pool[curr->conflict], agent2_id), catp2);
+			num_target_splits++;
+		}
+		else if (isMutexConflict(conflict_pool[curr->conflict]))
+		{
+			LL_num_generated += n1->add_barrier(conflict_pool.mutexConstraints(conflict_pool[curr->conflict], 0), catp1);
+			LL_num_generated += n2->add_barrier(conflict_pool.mutexConstraints(conflict_pool[curr->conflict], 1), catp2);
+			num_mutex_splits++;
+		}
+		else
+		{
+			vector<Constraint> barrier;
+			getRectangleBarrier(conflict_pool[curr->conflict], agent1_id, barrier);
+			LL_num_generated += n1->add_barrier(barrier, catp1);
+			getRectangleBarrier(conflict_pool[curr->conflict], agent2_id, barrier);
+			LL_num_generated += n2->add_barrier(barrier, catp2);
+			num_rectangle_splits++;
+		}
+	}
+	else if (split == split_strategy::RANDOM)  // A disjoint split that chooses the agent to work on randomly
 	{
 		int id;
 		if (rand() % 2 == 0) {
@@ -819,6 +1807,8 @@ void ICBSSearch::branch(ICBSNode* curr, ICBSNode* n1, ICBSNode* n2)
 		}
 
 		addPositiveConstraintsOnNarrowLevelsLeadingToPositiveConstraint(id, timestep, n1, n2, catp);
+		// The other agent can't be at the landmark too
+		constrainAgentOfConflict(curr, n1, id == agent1_id ? agent2_id : agent1_id, false);
 	}
 	else if (split == split_strategy::SINGLETONS)  // A disjoint split that chooses the agent to work on to be the one
 												   // with the smaller number of 1-width levels in each agent's MDD,
@@ -866,6 +1856,8 @@ void ICBSSearch::branch(ICBSNode* curr, ICBSNode* n1, ICBSNode* n2)
 
 		if (max(num_singletons_1, num_singletons_2) > 1)  // There are narrow levels in the agent's MDD
 			addPositiveConstraintsOnNarrowLevelsLeadingToPositiveConstraint(id, timestep, n1, n2, catp);
+		// The other agent can't be at the landmark too
+		constrainAgentOfConflict(curr, n1, id == agent1_id ? agent2_id : agent1_id, false);
 	}
 	else if (split == split_strategy::WIDTH)
 	{
@@ -903,6 +1895,8 @@ void ICBSSearch::branch(ICBSNode* curr, ICBSNode* n1, ICBSNode* n2)
 		}
 
 		addPositiveConstraintsOnNarrowLevelsLeadingToPositiveConstraint(id, timestep, n1, n2, catp);
+		// The other agent can't be at the landmark too
+		constrainAgentOfConflict(curr, n1, id == agent1_id ? agent2_id : agent1_id, false);
 	}
 	else  // Do a non-disjoint split
 	{
@@ -931,28 +1925,130 @@ void ICBSSearch::branch(ICBSNode* curr, ICBSNode* n1, ICBSNode* n2)
 	}
 }
 
-// Plan paths for a node. Returns whether a path was found.
+// Split a vertex or edge conflict three ways: the first agent must be at the conflict and the second mustn't, the
+// reverse, or neither agent may be there. Both agents are constrained in every child, unlike the two-way disjoint
+// splits, where the child that forbids the chosen agent lets the other agent keep the conflict's location, so the
+// same conflict can be split again below it.
+void ICBSSearch::branchDisjoint3(ICBSNode* curr, ICBSNode* n1, ICBSNode* n2, ICBSNode* n3)
+{
+	auto [agent1_id, agent2_id, location1, location2, timestep] = conflict_pool[curr->conflict];
+	n1->agent_id = agent1_id;
+	n2->agent_id = agent2_id;
+	n3->agent_id = agent1_id;
+	constrainAgentOfConflict(curr, n1, agent1_id, true);
+	constrainAgentOfConflict(curr, n1, agent2_id, false);
+	constrainAgentOfConflict(curr, n2, agent2_id, true);
+	constrainAgentOfConflict(curr, n2, agent1_id, false);
+	constrainAgentOfConflict(curr, n3, agent1_id, false);
+	constrainAgentOfConflict(curr, n3, agent2_id, false);
+}
+
+// Add the constraint of the node's vertex or edge conflict on one of its agents to the child - a landmark if positive.
+// The constraint on the second agent of an edge conflict is on traversing the edge in the opposite direction.
+void ICBSSearch::constrainAgentOfConflict(ICBSNode* curr, ICBSNode* child, int ag, bool positive)
+{
+	auto [agent1_id, agent2_id, location1, location2, timestep] = conflict_pool[curr->conflict];
+	std::vector<std::unordered_map<int, AvoidanceState>>* catp = nullptr;
+#ifndef LPA
+#else
+	// build a conflict-avoidance table for the agent's LPA* instance, which only gets the negative constraints
+	std::vector < std::unordered_map<int, AvoidanceState > > cat;
+	if (!positive)
+	{
+		cat.resize(curr->makespan + 1);
+		buildConflictAvoidanceTable(paths, ag, *curr, cat);
+		catp = &cat;
+	}
+#endif
+	int child_agent_id = child->agent_id;
+	child->agent_id = ag;  // add_constraint constrains the node's agent
+	if (location2 >= 0 && ag == agent2_id)
+		LL_num_generated += child->add_constraint(make_tuple(location2, location1, timestep, positive), catp);
+	else
+		LL_num_generated += child->add_constraint(make_tuple(location1, location2, timestep, positive), catp);
+	child->agent_id = child_agent_id;
+}
+
+// Generate the children of a DISJOINT3 split of the node's vertex or edge conflict and add them to OPEN.
+// Assumes the paths vector was switched to the node.
+void ICBSSearch::generateDisjoint3Children(ICBSNode* curr)
+{
+	ICBSNode* children[3] = {new ICBSNode(curr), new ICBSNode(curr), new ICBSNode(curr)};
+	branchDisjoint3(curr, children[0], children[1], children[2]);
+	for (ICBSNode* child : children)
+	{
+		bool success = generateChild(child, paths);
+		restorePaths();
+		if (screen == 1)
+		{
+			if (success)
+				std::cout << "Generated child #" << child->time_generated << " with cost " << child->g_val
+				          << " and " << child->num_of_conflicts << " conflicts " << std::endl;
+			else
+				std::cout << "No feasible solution for a child! " << std::endl;
+		}
+	}
+}
+
+// Plan paths for a node and add it to OPEN. Returns whether a path was found.
 // Assumes parent_paths was initialized with the paths of the node's parent.
 bool ICBSSearch::generateChild(ICBSNode *node, vector<vector<PathEntry> *> &parent_paths)
+{
+	if (!planChild(node, parent_paths))
+		return false;
+
+	pushNode(node);
+
+	if (screen) // check the solution
+		arePathsConsistentWithConstraints(paths, node);
+
+	return true;
+}
+
+// Plan paths for a node and find its conflicts, without adding it to OPEN. Returns whether a path was found - the
+// node is deleted if it wasn't.
+// Assumes parent_paths was initialized with the paths of the node's parent.
+bool ICBSSearch::planChild(ICBSNode *node, vector<vector<PathEntry> *> &parent_paths)
 {
 	int h = 0;
-	for (auto con : node->negative_constraints[node->agent_id])
+	// The agents with new negative constraints - one, or two in a disjoint split, where the agent that conflicted
+	// with the new landmark must avoid it too
+	int a[2] = {-1, -1};
+	for (const auto& [constrained_agent, con] : node->constraints)
 	{
-		auto [loc1, loc2, timestep, positive_constraint] = con;
-		int a[2];
-		if (split == split_strategy::DISJOINT3)
-		{
-			a[0] = node->agent_id / num_of_agents - 1;
-			a[1] = node->agent_id % num_of_agents;
-		}
-		else
-		{
-			a[0] = node->agent_id;
-			a[1] = -1;
-		}
+		if (!std::get<3>(con) && constrained_agent != a[0] && constrained_agent != a[1])
+			a[a[0] < 0 ? 0 : 1] = constrained_agent;
+	}
+	// Each constrained agent is replanned once, after going over all its new negative constraints (several for a
+	// barrier), with the highest lower bound on its cost they imply
+	int lowerbounds[2] = {-1, -1};
+	int replan_timesteps[2] = {INT_MAX, INT_MAX};
+	bool postponed[2] = {false, false};
+	for (const auto& [constrained_agent, con] : node->constraints)
+	{
+		auto [loc1, loc2, first_timestep, positive_constraint] = con;
+		if (positive_constraint)
+			continue;
 		for (int i = 0; i < 2 && a[i] >= 0; i++)
 		{
-			if (loc2 < 0 && timestep > parent_paths[a[i]]->size())  // The agent is forced out of its goal - the cost will surely increase
+			if (a[i] != constrained_agent)
+				continue;
+			// A range constraint is classified like a vertex constraint at the first timestep of the range the path
+			// violates it at
+			int timestep = first_timestep;
+			if (isRangeConstraint(con))
+			{
+				for (int t = first_timestep; t <= rangeEnd(con) && t < (int)parent_paths[a[i]]->size(); t++)
+				{
+					if (parent_paths[a[i]]->at(t).location == loc1)
+					{
+						timestep = t;
+						break;
+					}
+				}
+			}
+			if ((loc2 < 0 || isLengthConstraint(con)) && !node->isMerged(a[i]) &&
+			    timestep > parent_paths[a[i]]->size())  // The agent is forced out of its goal - the cost will surely increase
 				// FIXME: Assumes the cost function is sum-of-costs
 			{
 				// Partial expansion - delay path finding:
@@ -963,10 +2059,13 @@ bool ICBSSearch::generateChild(ICBSNode *node, vector<vector<PathEntry> *> &pare
 				node->new_paths.push_back(newPath);
 				h += timestep - (int)parent_paths[a[i]]->size();
 				node->partialExpansion = true;
+				postponed[i] = true;
 				continue;
 			}
 			int lowerbound;
-			if (timestep >= (int)parent_paths[a[i]]->size()) // conflict happens after agent reaches its goal
+			if (isLengthConstraint(con))
+				lowerbound = timestep + 1;
+			else if (timestep >= (int)parent_paths[a[i]]->size()) // conflict happens after agent reaches its goal
 				// (because constraints are on the same time as the conflict
 				// or earlier due to propagation)
 				lowerbound = timestep + 1;
@@ -974,85 +2073,36 @@ bool ICBSSearch::generateChild(ICBSNode *node, vector<vector<PathEntry> *> &pare
 				lowerbound = (int)parent_paths[a[i]]->size() - 1;
 			else if (!parent_paths[a[i]]->at(timestep).single) // not cardinal
 				lowerbound = (int)parent_paths[a[i]]->size() - 1;
+			else if (loc2 < 0 && parent_paths[a[i]]->at(timestep).location != loc1) // a barrier cell the path avoids
+				lowerbound = (int)parent_paths[a[i]]->size() - 1;
 			else if (loc1 >= 0 && loc2 < 0) // cardinal vertex
 				lowerbound = (int)parent_paths[a[i]]->size();
 			else if (parent_paths[a[i]]->at(timestep - 1).builtMDD && parent_paths[a[i]]->at(timestep - 1).single) // Cardinal edge
 				lowerbound = (int)parent_paths[a[i]]->size();
 			else // Not cardinal edge
 				lowerbound = (int)parent_paths[a[i]]->size() - 1;
-
-			if (!findPathForSingleAgent(node, parent_paths, nullptr, timestep, lowerbound, a[i]))
+			lowerbounds[i] = max(lowerbounds[i], lowerbound);
+			replan_timesteps[i] = min(replan_timesteps[i], first_timestep);
+		}
+	}
+	for (int i = 0; i < 2 && a[i] >= 0; i++)
+	{
+		if (lowerbounds[i] < 0 || postponed[i])
+			continue;
+		if (node->isMerged(a[i]))  // The members of a meta-agent are only planned together
+		{
+			if (!findPathsForMetaAgent(node, parent_paths, node->metaAgentOf(a[i])))
 			{
 				delete node;
 				return false;
 			}
 		}
-	}
-	for (int ag = 0; ag < num_of_agents; ++ag) {
-		if (ag == node->agent_id)
-		{
-			continue;  // Positive constraints affect all agents except the specified agent
-		}
-
-		for (auto con : node->positive_constraints[ag])
+		else if (!findPathForSingleAgent(node, parent_paths, nullptr, replan_timesteps[i], lowerbounds[i], a[i]))
 		{
-			auto [loc1, loc2, timestep, positive_constraint] = con;
-			if (loc2 < 0 &&  // vertex constraint
-				getAgentLocation(parent_paths, timestep, ag) == loc1)  // The agent is in violation of the positive constraint
-			{
-				if (timestep > parent_paths[ag]->size())  // The agent is forced out of its goal - the cost will surely increase
-					// FIXME: Assumes the cost function is sum-of-costs
-				{
-					// Partial expansion - postpone path finding:
-					pair<int, vector<PathEntry>> newPath;
-					newPath.first = ag;
-					newPath.second.resize(1);
-					newPath.second.back().location = timestep;
-					node->new_paths.push_back(newPath);
-					h += timestep - (int)parent_paths[ag]->size();
-					node->partialExpansion = true;
-				}
-				else if (!findPathForSingleAgent(node, parent_paths, nullptr, timestep,
-												 max((int) parent_paths[ag]->size() - 1, timestep), ag))
-				{
-					delete node;
-					return false;
-				}
-			}
-			else if (loc2 >= 0)  // edge constraint
-			{
-				if (getAgentLocation(parent_paths, timestep - 1, ag) == loc2 &&
-					getAgentLocation(parent_paths, timestep, ag) == loc1) // move from "to" to "from"
-				{
-					if (!findPathForSingleAgent(node, parent_paths, nullptr, timestep,
-												max((int) parent_paths[ag]->size() - 1, timestep), ag))
-					{
-						delete node;
-						return false;
-					}
-				}
-				else if (getAgentLocation(parent_paths, timestep - 1, ag) == loc1) // stay in location "from"
-				{
-					if (!findPathForSingleAgent(node, parent_paths, nullptr, timestep - 1,
-												max((int) parent_paths[ag]->size() - 1, timestep), ag))
-					{
-						delete node;
-						return false;
-					}
-				}
-				else if (getAgentLocation(parent_paths, timestep, ag) == loc2) // stay in location "to"
-				{
-					if (!findPathForSingleAgent(node, parent_paths, nullptr, timestep,
-												max((int) parent_paths[ag]->size() - 1, timestep), ag))
-					{
-						delete node;
-						return false;
-					}
-				}
-			}
+			delete node;
+			return false;
 		}
 	}
-
 	if (!node->partialExpansion) {
 		// Check for partial expansion carried over from the parent or something
 		// TODO: Can happen?
@@ -1083,18 +2133,6 @@ bool ICBSSearch::generateChild(ICBSNode *node, vector<vector<PathEntry> *> &pare
 
 	node->num_of_conflicts = (int)node->unknownConf.size() + (int)node->cardinalConf.size() +
                              (int)node->semiConf.size() + (int)node->nonConf.size();
-
-	// update handles
-	node->open_handle = open_list.push(node);
-	HL_num_generated++;
-	node->time_generated = HL_num_generated;
-	if (node->f_val <= focal_list_threshold)
-		node->focal_handle = focal_list.push(node);
-	allNodes_table.push_back(node);
-
-	if (screen) // check the solution
-		arePathsConsistentWithConstraints(paths, node);
-
 	return true;
 }
 
@@ -1119,28 +2157,21 @@ bool ICBSSearch::findPathForSingleAgent(ICBSNode *node, vector<vector<PathEntry>
 	}
 
 	// Prepare the place we'll put the path
-    vector<PathEntry>* newPath = nullptr;
-    if (!skipNewpaths) {
-        // Linear lookup:
-        bool found = false;
-        auto it = node->new_paths.begin();
-        for ( ; it != node->new_paths.end(); ++it)
-            // Check if the agent has an empty path in new_paths. If it does, update its path entry.
-        {
-            if (it->first == ag && it->second.size() <= 1)  // trivial entry - replace it
-            {
-                found = true;
-                break;
-            }
-            if (it->first > ag)  // Passed it - insert here
-                break;
-        }
-        if (!found)
-            it = node->new_paths.emplace(it);  // Inserts before the iterator
-        it->first = ag;
-        newPath = &it->second;
-    } else
-        newPath = new vector<PathEntry>();
+	vector<PathEntry>* newPath = nullptr;
+	if (!skipNewpaths)
+		newPath = newPathOf(node, ag);
+	else
+		newPath = new vector<PathEntry>();
+	if (start.second > 0 || goal.second < (int)the_paths[ag]->size())
+	{
+		// Only the segment between the landmarks is replanned - keep the rest of the current path. The MDD of the
+		// new path isn't known.
+		*newPath = *the_paths[ag];
+		if (goal.second >= (int)the_paths[ag]->size())
+			newPath->resize(start.second + 1, the_paths[ag]->back());
+		for (int t = 1; t < (int)newPath->size(); t++)
+			newPath->at(t).builtMDD = false;
+	}
 
 	// A path w.r.t cons_table (and prioritize by the conflict-avoidance table).
 	bool foundSol;
@@ -1192,10 +2223,18 @@ bool ICBSSearch::findPathForSingleAgent(ICBSNode *node, vector<vector<PathEntry>
 			if (screen)
 				cout << "Calling normal A* for agent " << ag << " instead of LPA* because LPA* can't handle a changed "
 						"start, and can't recover if it was unable in the past" << endl;
-			if (node->lpas[ag] != NULL) {
+			if (node->lpas[ag] != NULL && !skipNewpaths) {
+				{
+					// A node finishing its partial expansion is already in OPEN, with its copies in lpa_copies
+					ICBSSearch& search = master != nullptr ? *master : *this;
+					std::lock_guard<std::mutex> lock(search.frontier_mutex);
+					search.lpa_copies.erase(node->lpas[ag]);
+				}
 				delete node->lpas[ag];  // We've just created this copy - it's unused anywhere else
 				node->lpas[ag] = NULL;
 			}
+			// ID-CBSH keeps it - it pops the constraints from it on backtracking, and it's used again once the
+			// agent's landmarks are popped
 			clock_t ll_start = std::clock();
 			auto wall_ll_start = std::chrono::system_clock::now();
 			foundSol = search_engines[ag]->findShortestPath(*newPath, cons_table, *the_cat, start, goal,
@@ -1226,6 +2265,8 @@ bool ICBSSearch::findPathForSingleAgent(ICBSNode *node, vector<vector<PathEntry>
     if (skipNewpaths && the_paths[ag] != &paths_found_initially[ag])
         delete the_paths[ag];
     the_paths[ag] = newPath;
+    if (!skipNewpaths)
+        replanned_agents.push_back(ag);
     node->makespan = max(node->makespan, (int)newPath->size() - 1);
 
 	if (screen)
@@ -1234,28 +2275,269 @@ bool ICBSSearch::findPathForSingleAgent(ICBSNode *node, vector<vector<PathEntry>
 	return true;
 }
 
-// plan paths that are not planned yet due to partial expansion
-bool ICBSSearch::finishPartialExpansion(ICBSNode *node, vector<vector<PathEntry> *> &the_paths)
+// The place in the node's new paths for a new path of the agent
+vector<PathEntry>* ICBSSearch::newPathOf(ICBSNode *node, int ag)
+{
+    // Linear lookup:
+    bool found = false;
+    auto it = node->new_paths.begin();
+    for ( ; it != node->new_paths.end(); ++it)
+        // Check if the agent has an empty path in new_paths. If it does, update its path entry.
+    {
+        if (it->first == ag && it->second.size() <= 1)  // trivial entry - replace it
+        {
+            found = true;
+            break;
+        }
+        if (it->first > ag)  // Passed it - insert here
+            break;
+    }
+    if (!found)
+        it = node->new_paths.emplace(it);  // Inserts before the iterator
+    it->first = ag;
+    return &it->second;
+}
+
+// plan paths that are not planned yet due to partial expansion
+// Assumes the paths vector was switched to the node. The node is deleted if a path wasn't found.
+bool ICBSSearch::finishPartialExpansion(ICBSNode *node, vector<vector<PathEntry> *> &the_paths)
+{
+	for(auto p: node->new_paths)
+	{
+		if (p.second.size() <= 1)
+		{
+			if (!findPathForSingleAgent(node, the_paths, nullptr, p.second.back().location, p.second.back().location, p.first))
+			{
+				restorePaths();
+				switchPaths(node->parent);
+				return false;  // The node is dropped but stays in allNodes_table, which frees it
+			}
+		}
+	}
+	// The placeholders are real paths now
+	undoPathsOf(node);
+	applyPathsOf(node);
+	replanned_agents.clear();
+	node->h_val = max(node->parent->f_val - node->g_val, 0);
+	node->f_val = node->g_val + node->h_val;
+	findConflicts(*node);  // Conflicts involving agents whose paths were unchanged in this node were already copied from the parent
+	node->num_of_conflicts = (int) node->unknownConf.size() + (int) node->cardinalConf.size() +
+                             (int) node->semiConf.size() + (int) node->nonConf.size();
+
+	HL_num_reexpanded++;
+	node->partialExpansion = false;
+	return true;
+}
+
+//////////////////// MERGE ///////////////////////////
+// Whether the meta-agents of the node's conflict conflicted more than merge_threshold times on its branch, counting
+// this conflict, so they should be merged instead of splitting the conflict again.
+// Merging is limited to non-disjoint splits, since the positive constraints of the other splits replan single
+// agents.
+bool ICBSSearch::shouldMerge(const ICBSNode *curr) const
+{
+	if (merge_threshold < 0 || split != split_strategy::NON_DISJOINT)
+		return false;
+	int m1 = curr->metaAgentOf(std::get<0>(conflict_pool[curr->conflict]));
+	int m2 = curr->metaAgentOf(std::get<1>(conflict_pool[curr->conflict]));
+	int count = 0;
+	for (const ICBSNode* node = curr; node != nullptr; node = node->parent)
+	{
+		if (node->conflict == NO_CONFLICT)
+			continue;
+		// The conflicts of the members of the meta-agents count as theirs
+		int n1 = curr->metaAgentOf(std::get<0>(conflict_pool[node->conflict]));
+		int n2 = curr->metaAgentOf(std::get<1>(conflict_pool[node->conflict]));
+		if ((n1 == m1 && n2 == m2) || (n1 == m2 && n2 == m1))
+			count++;
+	}
+	return count > merge_threshold;
+}
+
+// Plan a child that merges the meta-agents of the node's conflict instead of splitting it. The child has the same
+// constraints, and the merged meta-agent is planned by findPathsForMetaAgent, which it will be from now on whenever a
+// constraint is added to one of its members. Returns whether paths were found - the child is deleted if they weren't.
+// Assumes the_paths was initialized with the paths of the node.
+bool ICBSSearch::planMergedChild(ICBSNode *curr, ICBSNode *node, vector<vector<PathEntry> *> &the_paths)
+{
+	int m1 = curr->metaAgentOf(std::get<0>(conflict_pool[curr->conflict]));
+	int m2 = curr->metaAgentOf(std::get<1>(conflict_pool[curr->conflict]));
+	auto meta_agents = std::make_shared<vector<int>>(curr->meta_agents != nullptr ? *curr->meta_agents :
+	                                                 vector<int>(num_of_agents, -1));
+	for (int ag = 0; ag < num_of_agents; ag++)
+	{
+		if (curr->metaAgentOf(ag) != m1 && curr->metaAgentOf(ag) != m2)
+			continue;
+		(*meta_agents)[ag] = min(m1, m2);
+		node->lpas[ag] = nullptr;  // Its LPA* instance won't know the paths the meta-agent is planned with
+	}
+	node->meta_agents = meta_agents;
+	node->agent_id = min(m1, m2);
+	if (!findPathsForMetaAgent(node, the_paths, min(m1, m2)))
+	{
+		delete node;
+		return false;
+	}
+	num_merges++;
+
+	node->h_val = max(curr->f_val - node->g_val, 0);
+	node->f_val = node->g_val + node->h_val;
+	copyConflictsFromParent(*node);
+	findConflicts(*node);
+	node->num_of_conflicts = (int)node->unknownConf.size() + (int)node->cardinalConf.size() +
+	                         (int)node->semiConf.size() + (int)node->nonConf.size();
+	return true;
+}
+
+// Plan the members of a meta-agent together under the constraints of the node with a small CBS that uses their A*
+// engines, like solve2Agents, and put their paths in the node and in the_paths. The paths have the lowest sum of costs
+// of any paths of the members without conflicts between them.
+// Returns false if there are no such paths, or the search ran out of time.
+bool ICBSSearch::findPathsForMetaAgent(ICBSNode *node, vector<vector<PathEntry> *> &the_paths, int meta_agent)
 {
-	for(auto p: node->new_paths)
+	struct SubNode
 	{
-		if (p.second.size() <= 1)
+		vector<vector<PathEntry>> paths;  // of each member
+		int parent;  // index in the nodes vector, -1 for the root
+		int member;  // the member the constraint is imposed on
+		Constraint constraint;
+		int cost;
+	};
+
+	clock_t ll_start = std::clock();
+	auto wall_ll_start = std::chrono::system_clock::now();
+	vector<int> members;
+	for (int ag = 0; ag < num_of_agents; ag++)
+		if (node->metaAgentOf(ag) == meta_agent)
+			members.push_back(ag);
+	int num_members = (int)members.size();
+	std::vector<std::unordered_map<int, AvoidanceState> > empty_cat(1);
+	vector<std::vector<std::unordered_map<int, ConstraintState> > > base_cons_tables(num_members);
+	vector<int> base_last_goal_cons_timestep(num_members);
+	vector<SubNode> nodes(1);
+	nodes[0].parent = -1;
+	nodes[0].member = -1;
+	nodes[0].paths.resize(num_members);
+	nodes[0].cost = 0;
+	bool found = true;
+	for (int i = 0; i < num_members && found; i++)
+	{
+		int ag = members[i];
+		base_cons_tables[i].resize(node->makespan + 1);
+		pair<int, int> start(search_engines[ag]->start_location, 0), goal(search_engines[ag]->goal_location, INT_MAX);
+		base_last_goal_cons_timestep[i] = buildConstraintTable(node, ag, 0, base_cons_tables[i], start, goal);
+		found = search_engines[ag]->findShortestPath(nodes[0].paths[i], base_cons_tables[i], empty_cat, start, goal, 0,
+		                                             base_last_goal_cons_timestep[i]);
+		LL_num_expanded += search_engines[ag]->num_expanded;
+		LL_num_generated += search_engines[ag]->num_generated;
+		nodes[0].cost += (int)nodes[0].paths[i].size() - 1;
+	}
+
+	// (cost, index in nodes)
+	std::priority_queue<pair<int, int>, vector<pair<int, int>>, std::greater<pair<int, int>>> open;
+	if (found)
+		open.push(make_pair(nodes[0].cost, 0));
+	int solution = -1;
+	while (!open.empty() && solution < 0)
+	{
+		if (runtime + (std::clock() - ll_start) > time_limit * CLOCKS_PER_SEC || cancelled())
+			break;
+		int id = open.top().second;
+		open.pop();
+
+		// The earliest conflict between two members
+		Conflict conflict;
+		int conflict_members[2] = {-1, -1};
+		for (int i = 0; i < num_members; i++)
 		{
-			if (!findPathForSingleAgent(node, the_paths, nullptr, p.second.back().location, p.second.back().location, p.first))
+			for (int j = i + 1; j < num_members; j++)
 			{
-				delete node;
-				return false;
+				const vector<PathEntry>* pair_paths[2] = {&nodes[id].paths[i], &nodes[id].paths[j]};
+				Conflict pair_conflict;
+				if (findFirstConflict(pair_paths, pair_conflict) &&
+				    (conflict_members[0] < 0 || std::get<4>(pair_conflict) < std::get<4>(conflict)))
+				{
+					int pair_members[2] = {i, j};
+					conflict = pair_conflict;
+					conflict_members[0] = pair_members[std::get<0>(pair_conflict)];
+					conflict_members[1] = pair_members[std::get<1>(pair_conflict)];
+				}
+			}
+		}
+		if (conflict_members[0] < 0)
+		{
+			solution = id;
+			break;
+		}
+
+		auto [agent1, agent2, location1, location2, timestep] = conflict;
+		for (int k = 0; k < 2; k++)
+		{
+			int i = conflict_members[k];
+			SubNode child;
+			child.parent = id;
+			child.member = i;
+			if (location2 >= 0 && k == 1)  // the constraint is on traversing the edge in the opposite direction
+				child.constraint = make_tuple(location2, location1, timestep, false);
+			else
+				child.constraint = make_tuple(location1, location2, timestep, false);
+			child.paths = nodes[id].paths;
+
+			// Add the constraints of this branch of the sub-problem to the member's constraint table
+			int ag = members[i];
+			std::vector<std::unordered_map<int, ConstraintState> > cons_table(base_cons_tables[i]);
+			int last_goal_cons_timestep = base_last_goal_cons_timestep[i];
+			for (const SubNode* n = &child; n->parent != -1; n = &nodes[n->parent])
+			{
+				if (n->member != i)
+					continue;
+				auto [loc1, loc2, constraint_timestep, positive_constraint] = n->constraint;
+				growConstraintTable(cons_table, constraint_timestep + 1);
+				if (loc2 < 0) // vertex constraint
+				{
+					cons_table[constraint_timestep][loc1].vertex = true;
+					if (loc1 == search_engines[ag]->goal_location && last_goal_cons_timestep < constraint_timestep)
+						last_goal_cons_timestep = constraint_timestep;
+				}
+				else // edge constraint
+				{
+					for (int m = 0; m < MapLoader::valid_moves_t::WAIT_MOVE; m++)
+					{
+						if (loc2 - loc1 == moves_offset[m])
+							cons_table[constraint_timestep][loc2].edge[m] = true;
+					}
+				}
 			}
+
+			pair<int, int> start(search_engines[ag]->start_location, 0), goal(search_engines[ag]->goal_location, INT_MAX);
+			int old_cost = (int)child.paths[i].size() - 1;
+			bool found_path = search_engines[ag]->findShortestPath(child.paths[i], cons_table, empty_cat, start, goal,
+			                                                       old_cost, last_goal_cons_timestep);
+			LL_num_expanded += search_engines[ag]->num_expanded;
+			LL_num_generated += search_engines[ag]->num_generated;
+			if (!found_path)
+				continue;
+			child.cost = nodes[id].cost - old_cost + (int)child.paths[i].size() - 1;
+			nodes.push_back(std::move(child));
+			open.push(make_pair(nodes.back().cost, (int)nodes.size() - 1));
 		}
 	}
-	node->h_val = max(node->parent->f_val - node->g_val, 0);
-	node->f_val = node->g_val + node->h_val;
-	findConflicts(*node);  // Conflicts involving agents whose paths were unchanged in this node were already copied from the parent
-	node->num_of_conflicts = (int) node->unknownConf.size() + (int) node->cardinalConf.size() +
-                             (int) node->semiConf.size() + (int) node->nonConf.size();
+	lowLevelTime += std::clock() - ll_start;
+	wall_lowLevelTime += std::chrono::system_clock::now() - wall_ll_start;
+	if (solution < 0)
+		return false;
 
-	HL_num_reexpanded++;
-	node->partialExpansion = false;
+	// update the_paths, g_val, and makespan
+	for (int i = 0; i < num_members; i++)
+	{
+		int ag = members[i];
+		vector<PathEntry>* newPath = newPathOf(node, ag);
+		*newPath = std::move(nodes[solution].paths[i]);
+		node->g_val = node->g_val - (int)the_paths[ag]->size() + (int)newPath->size();
+		the_paths[ag] = newPath;
+		replanned_agents.push_back(ag);
+		node->makespan = max(node->makespan, (int)newPath->size() - 1);
+	}
 	return true;
 }
 
@@ -1268,10 +2550,31 @@ bool ICBSSearch::arePathsConsistentWithConstraints(vector<vector<PathEntry> *> &
 		return true;
 	while (curr != nullptr)
 	{
-		for (int agent = 0; agent < num_of_agents; ++agent) {
-			for (auto con : curr->negative_constraints[agent]) {
-				auto [loc1, loc2, timestep, positive_constraint] = con;
-				if (loc2 < 0) // vertex constraint
+		for (const auto& [agent, con] : curr->constraints) {
+			auto [loc1, loc2, timestep, positive_constraint] = con;
+			if (!positive_constraint) {
+				if (isLengthConstraint(con))
+				{
+					if ((int)the_paths[agent]->size() - 1 <= timestep)
+					{
+						std::cout << "Path " << agent << " violates constraint " << con << std::endl;
+						exit(1);
+					}
+				}
+				else if (isRangeConstraint(con))
+				{
+					// The agent stays at the end of its path, so it's enough to check the range until then
+					int last_timestep = min(rangeEnd(con), max(timestep, (int)the_paths[agent]->size() - 1));
+					for (int t = timestep; t <= last_timestep; t++)
+					{
+						if (the_paths[agent]->at(min(t, (int)the_paths[agent]->size() - 1)).location == loc1)
+						{
+							std::cout << "Path " << agent << " violates constraint " << con << std::endl;
+							exit(1);
+						}
+					}
+				}
+				else if (loc2 < 0) // vertex constraint
 				{
 					if (the_paths[agent]->size() > timestep && the_paths[agent]->at(timestep).location == loc1)
 					{
@@ -1295,61 +2598,17 @@ bool ICBSSearch::arePathsConsistentWithConstraints(vector<vector<PathEntry> *> &
 					}
 				}
 			}
-
-			for (auto con : curr->positive_constraints[agent]) {
-				auto [loc1, loc2, timestep, positive_constraint] = con;
-				for (int other_agent = 0; other_agent < num_of_agents; other_agent++)
+			else  // a landmark - the agent must be at the location, or traverse the edge, at the timestep. The agents it
+				  // conflicted with have their own negative constraints.
+			{
+				// The agent stays at its goal after its path ends
+				int last = (int)the_paths[agent]->size() - 1;
+				if ((loc2 < 0 && the_paths[agent]->at(min(timestep, last)).location != loc1) ||
+					(loc2 >= 0 && (the_paths[agent]->at(min(timestep - 1, last)).location != loc1 ||
+								   the_paths[agent]->at(min(timestep, last)).location != loc2)))
 				{
-					if (other_agent == agent)
-					{
-						if (loc2 < 0) // vertex constraint
-						{
-							if (timestep < the_paths[other_agent]->size() && the_paths[other_agent]->at(timestep).location != loc1)
-							{
-								std::cout << "Path " << other_agent << " violates constraint " << con << std::endl;
-								exit(1);
-							}
-						}
-						else // edge constraint
-						{
-							if (timestep < the_paths[other_agent]->size() &&
-								(the_paths[other_agent]->at(timestep - 1).location != loc1 ||
-								 the_paths[other_agent]->at(timestep).location != loc2))
-							{
-								std::cout << "Path " << other_agent << " violates constraint " << con << std::endl;
-								exit(1);
-							}
-						}
-					}
-					else  // The positive constraint is on a different agent - an implicit negative constraint for this agent
-					{
-						if (timestep >= the_paths[other_agent]->size())
-						{
-							if (loc2 < 0 && the_paths[other_agent]->at(the_paths[other_agent]->size() - 1).location == loc1)
-							{
-								std::cout << "Path " << other_agent << " violates constraint " << con << std::endl;
-								exit(1);
-							}
-						}
-						else if (loc2 < 0) // vertex constraint
-						{
-							if (the_paths[other_agent]->at(timestep).location == loc1)
-							{
-								std::cout << "Path " << other_agent << " violates constraint " << con << std::endl;
-								exit(1);
-							}
-						}
-						else // edge constraint
-						{
-							if ((the_paths[other_agent]->at(timestep - 1).location == loc2 && the_paths[other_agent]->at(timestep).location == loc1) ||
-								the_paths[other_agent]->at(timestep - 1).location == loc1 ||
-								the_paths[other_agent]->at(timestep).location == loc2)
-							{
-								std::cout << "Path " << other_agent << " violates constraint " << con << std::endl;
-								exit(1);
-							}
-						}
-					}
+					std::cout << "Path " << agent << " violates constraint " << con << std::endl;
+					exit(1);
 				}
 			}
 		}
@@ -1459,8 +2718,73 @@ inline void ICBSSearch::populatePaths(ICBSNode *curr, vector<vector<PathEntry> *
 			the_paths[i] = &paths_found_initially[i];
 }
 
+// Switches the paths vector from the paths of paths_node to those of the target node: undoes the paths the nodes from
+// paths_node up to the lowest common ancestor of the two gave their agents, then applies the paths the nodes from there
+// down to the target gave theirs. Only the paths of agents that were replanned between the two nodes change.
+void ICBSSearch::switchPaths(ICBSNode *target)
+{
+	if (paths_node == nullptr)
+	{
+		path_versions.assign(num_of_agents, {});
+		for (int i = 0; i < num_of_agents; i++)
+			paths[i] = &paths_found_initially[i];
+		paths_node = root_node;
+	}
+	vector<ICBSNode*> down;  // from the target up to the common ancestor
+	ICBSNode* from = paths_node;
+	ICBSNode* to = target;
+	while (from != to)
+	{
+		if (from->depth >= to->depth)
+		{
+			undoPathsOf(from);
+			from = from->parent;
+		}
+		else
+		{
+			down.push_back(to);
+			to = to->parent;
+		}
+	}
+	for (auto it = down.rbegin(); it != down.rend(); ++it)
+		applyPathsOf(*it);
+	paths_node = target;
+}
+
+// Point the agents the node gave paths to back at the paths they had in its parent
+void ICBSSearch::undoPathsOf(const ICBSNode *node)
+{
+	for (const auto& [ag, path] : node->new_paths)
+	{
+		if (path_versions[ag].empty() || path_versions[ag].back().first != node)
+			continue;
+		path_versions[ag].pop_back();
+		paths[ag] = pathOfPathsNode(ag);
+	}
+}
+
+// Point the agents the node gave paths to at them. Like populatePaths, placeholders of partial expansion are skipped.
+void ICBSSearch::applyPathsOf(ICBSNode *node)
+{
+	for (auto& [ag, path] : node->new_paths)
+	{
+		if (path.size() <= 1 || (!path_versions[ag].empty() && path_versions[ag].back().first == node))
+			continue;
+		path_versions[ag].emplace_back(node, &path);
+		paths[ag] = &path;
+	}
+}
+
+// Point the agents that were replanned for a child of paths_node back at the paths they have in paths_node
+void ICBSSearch::restorePaths()
+{
+	for (int ag : replanned_agents)
+		paths[ag] = pathOfPathsNode(ag);
+	replanned_agents.clear();
+}
+
 // adding new nodes to FOCAL (those with min-f-val*f_weight between the old and new LB)
-void ICBSSearch::updateFocalList(double old_lower_bound, double new_lower_bound, double f_weight)
+void ICBSSearch::updateFocalList(double old_lower_bound, double new_lower_bound, double)
 {
 	for (ICBSNode* n : open_list) 
 	{
@@ -1475,20 +2799,74 @@ bool ICBSSearch::reinsert(ICBSNode* curr)
 	if (curr->f_val > focal_list_threshold)
 	{
 		curr->open_handle = open_list.push(curr);
-		ICBSNode* open_head = open_list.top();
-		if (open_head->f_val > min_f_val) 
-		{
-			min_f_val = open_head->f_val;
-			double new_focal_list_threshold = min_f_val * focal_w;
-			updateFocalList(focal_list_threshold, new_focal_list_threshold, focal_w);
-			focal_list_threshold = new_focal_list_threshold;
-		}
+		updateLowerBound();
 		return true;
 	}
 	else
 		return false;
 }
 
+// Add a generated node to OPEN, and to FOCAL if it's good enough.
+// Workers add it to their master's lists.
+void ICBSSearch::pushNode(ICBSNode* node)
+{
+	ICBSSearch& search = master != nullptr ? *master : *this;
+	std::lock_guard<std::mutex> lock(search.frontier_mutex);
+	node->open_handle = search.open_list.push(node);
+	search.HL_num_generated++;
+	node->time_generated = search.HL_num_generated;
+	if (node->f_val <= search.focal_list_threshold)
+	{
+		node->focal_handle = search.focal_list.push(node);
+		search.frontier_changed.notify_one();
+	}
+	search.allNodes_table.push_back(node);
+	for (int ag = 0; ag < (int) node->lpas.size(); ag++)
+		if (node->lpas[ag] != nullptr && node->lpas[ag] != node->parent->lpas[ag])
+			search.lpa_copies.insert(node->lpas[ag]);
+}
+
+// The lowest f-value of the nodes in OPEN and the nodes the workers are expanding, or INT_MAX if there are none
+int ICBSSearch::lowestFVal() const
+{
+	int f_val = INT_MAX;
+	if (!open_list.empty())
+		f_val = open_list.top()->f_val;
+	if (!expanding_f_vals.empty())
+		f_val = min(f_val, *expanding_f_vals.begin());
+	return f_val;
+}
+
+// Raise min_f_val to the lowest f-value of the nodes that can still be expanded, and add the nodes that the new
+// lower bound lets in to FOCAL. The cost of the incumbent caps the lower bound - no solution costs more than it.
+void ICBSSearch::updateLowerBound()
+{
+	int f_val = lowestFVal();
+	if (incumbent != nullptr)
+		f_val = min(f_val, incumbent->g_val);
+	if (f_val == INT_MAX || f_val <= min_f_val)
+		return;
+	min_f_val = f_val;
+	double new_focal_list_threshold = min_f_val * focal_w;
+	updateFocalList(focal_list_threshold, new_focal_list_threshold, focal_w);
+	focal_list_threshold = new_focal_list_threshold;
+}
+
+// Finish a parallel search with the incumbent if no node in OPEN or being expanded can lead to a solution that's
+// cheaper than it by more than the suboptimality factor allows
+void ICBSSearch::acceptIncumbentIfProven()
+{
+	if (incumbent == nullptr)
+		return;
+	int f_val = lowestFVal();
+	if (f_val == INT_MAX || incumbent->g_val <= f_val * focal_w)
+	{
+		solution_found = true;
+		solution_cost = incumbent->g_val;
+		search_done = true;
+	}
+}
+
 
 //////////////////// PRINT ///////////////////////////
 void ICBSSearch::printPaths(vector<vector<PathEntry> *> &the_paths) const
@@ -1507,19 +2885,19 @@ void ICBSSearch::printConflicts(const ICBSNode &curr) const
 {
 	for (const auto& conflict: curr.cardinalConf)
 	{
-		std::cout << "Cardinal " << (*conflict) << std::endl;
+		std::cout << "Cardinal " << conflict_pool[conflict] << std::endl;
 	}
 	for (const auto& conflict : curr.semiConf)
 	{
-		std::cout << "Semi-cardinal " << (*conflict) << std::endl;
+		std::cout << "Semi-cardinal " << conflict_pool[conflict] << std::endl;
 	}
 	for (const auto& conflict : curr.nonConf)
 	{
-		std::cout << "Non-cardinal " << (*conflict) << std::endl;
+		std::cout << "Non-cardinal " << conflict_pool[conflict] << std::endl;
 	}
 	for (const auto& conflict : curr.unknownConf)
 	{
-		std::cout << "Unknown-cardinality " << (*conflict) << std::endl;
+		std::cout << "Unknown-cardinality " << conflict_pool[conflict] << std::endl;
 	}
 }
 
@@ -1528,15 +2906,9 @@ void ICBSSearch::printConstraints(const ICBSNode* n) const
 	const ICBSNode* curr = n;
 	while (curr != nullptr)
 	{
-		for (int j = 0; j < num_of_agents; ++j) {
-			for (auto con: curr->positive_constraints[j])
-			{
-				std::cout << curr->agent_id << ": " << con << std::endl;
-			}
-			for (auto con: curr->negative_constraints[j])
-			{
-				std::cout << curr->agent_id << ": " << con << std::endl;
-			}
+		for (const auto& [ag, con] : curr->constraints)
+		{
+			std::cout << ag << ": " << con << std::endl;
 		}
 		curr = curr->parent;
 	}
@@ -1546,11 +2918,18 @@ void ICBSSearch::printResults() const
 {
 	std::cout << "Status,Cost,Focal Delta,Root Cost,Root f,Wall PrepTime,PrepTime,Wall MDD Time,MDD Time,"
 				 "HL Expanded,HL Generated,LL Expanded,LL Generated,Wall HL runtime,HL runtime,"
-				 "Wall LL runtime,LL runtime,Wall Runtime,Runtime,Max Mem (kB)" << std::endl;
-	if (runtime > time_limit * CLOCKS_PER_SEC)  // timeout
+				 "Wall LL runtime,LL runtime,Wall Runtime,Runtime,Max Mem (kB),MDD Cache Hits,MDD Cache Hit Rate,"
+				 "MDD Cache Saved Time,MDD Incremental Updates,MDDs From LPA*,Windowed MDDs,"
+				 "ID Table Hits,ID Table Cutoffs,HL Bypassed,Rectangle Splits,Corridor Splits,Target Splits,"
+				 "Mutex Cardinal,Mutex Splits,Merges,BF Generated Before ID,ID Iterations" << std::endl;
+	if (timedOut())
 	{
 		std::cout << "Timeout,";
 	}
+	else if (!solution_found && cancelled())
+	{
+		std::cout << "Cancelled,";
+	}
 	else if (focal_list.empty() && solution_cost < 0)
 	{
 		std::cout << "No solutions,";
@@ -1574,10 +2953,64 @@ void ICBSSearch::printResults() const
 		((float) lowLevelTime) / CLOCKS_PER_SEC << "," <<
 		((float) wall_runtime.count()) / 1000000000 << "," <<
 		((float) runtime) / CLOCKS_PER_SEC << "," <<
-		max_mem <<
+		max_mem << "," <<
+		mdd_cache_hits << "," << getMddCacheHitRate() << "," <<
+		((float) mdd_cache_saved_time) / CLOCKS_PER_SEC << "," <<
+		mdd_num_incremental_updates << "," <<
+		mdd_num_from_lpa << "," <<
+		mdd_num_windowed << "," <<
+		id_table_hits << "," << id_table_cutoffs << "," <<
+		HL_num_bypassed << "," <<
+		num_rectangle_splits << "," <<
+		num_corridor_splits << "," <<
+		num_target_splits << "," <<
+		num_mutex_cardinal << "," <<
+		num_mutex_splits << "," <<
+		num_merges << "," <<
+		hybrid_switch_generated << "," <<
+		getIDIterations() <<
 		std::endl;
 }
 
+// Parallel searches, members of a portfolio and searches that run alongside others are cut off by wall time, since
+// the CPU time is that of all the threads of the process
+bool ICBSSearch::timedOut() const
+{
+	if (num_threads > 1 || in_portfolio || runs_concurrently)
+		return !solution_found && wall_runtime > std::chrono::seconds(time_limit);
+	return runtime > time_limit * CLOCKS_PER_SEC;
+}
+
+bool ICBSSearch::cancelled() const
+{
+	return shared->cancelled;
+}
+
+void ICBSSearch::cancel()
+{
+	shared->cancelled = true;
+}
+
+double ICBSSearch::getMddCacheHitRate() const
+{
+	if (mdd_cache_hits + mdd_cache_misses == 0)
+		return 0;
+	return ((double) mdd_cache_hits) / (mdd_cache_hits + mdd_cache_misses);
+}
+
+// threshold:expanded of each ID-CBSH iteration, separated by spaces
+string ICBSSearch::getIDIterations() const
+{
+	std::ostringstream iterations;
+	for (const auto& [threshold, expanded] : id_iterations)
+	{
+		if (iterations.tellp() > 0)
+			iterations << " ";
+		iterations << threshold << ":" << expanded;
+	}
+	return iterations.str();
+}
+
 void ICBSSearch::saveResults(const string& outputFile, const string& agentFile, const string& solver) const
 {
 	ofstream stats;
@@ -1586,7 +3019,10 @@ void ICBSSearch::saveResults(const string& outputFile, const string& agentFile,
 		stats.open(outputFile);
 		stats << "Cost,Focal Delta,Root Cost,Root f,Wall PrepTime,PrepTime,Wall MDD Time,MDD Time,"
 		          "HL Expanded,HL Generated,LL Expanded,LL Generated,Wall HL runtime,HL runtime,"
-		          "Wall LL runtime,LL runtime,Wall Runtime,Runtime,Max Mem (kB),solver,instance" << std::endl;
+		          "Wall LL runtime,LL runtime,Wall Runtime,Runtime,Max Mem (kB),MDD Cache Hits,MDD Cache Hit Rate,"
+		          "MDD Cache Saved Time,MDD Incremental Updates,MDDs From LPA*,Windowed MDDs,"
+		          "ID Table Hits,ID Table Cutoffs,HL Bypassed,Rectangle Splits,Corridor Splits,Target Splits,"
+		          "Mutex Cardinal,Mutex Splits,Merges,BF Generated Before ID,ID Iterations,solver,instance" << std::endl;
 	}
 	else
 		stats.open(outputFile, ios::app);
@@ -1606,6 +3042,21 @@ void ICBSSearch::saveResults(const string& outputFile, const string& agentFile,
 		((float) wall_runtime.count()) / 1000000000 << "," <<
 		((float) runtime) / CLOCKS_PER_SEC << "," <<
 		max_mem << "," <<
+		mdd_cache_hits << "," << getMddCacheHitRate() << "," <<
+		((float) mdd_cache_saved_time) / CLOCKS_PER_SEC << "," <<
+		mdd_num_incremental_updates << "," <<
+		mdd_num_from_lpa << "," <<
+		mdd_num_windowed << "," <<
+		id_table_hits << "," << id_table_cutoffs << "," <<
+		HL_num_bypassed << "," <<
+		num_rectangle_splits << "," <<
+		num_corridor_splits << "," <<
+		num_target_splits << "," <<
+		num_mutex_cardinal << "," <<
+		num_mutex_splits << "," <<
+		num_merges << "," <<
+		hybrid_switch_generated << "," <<
+		getIDIterations() << "," <<
 		solver << "," << agentFile << endl;
 	stats.close();
 }
@@ -1629,12 +3080,23 @@ bool ICBSSearch::runICBSSearch()
 	// set timer
 	std::clock_t start = std::clock();
 	auto wall_start = std::chrono::system_clock::now();
+	if (!in_portfolio)  // The members of a portfolio share a cache, set up before they start
+		mdd_cache.max_bytes = mdd_cache_max_bytes;
+	if (num_threads > 1)
+		return runParallelICBSSearch(start, wall_start);
+	std::unique_ptr<ICBSSearch> child_planner;  // plans the right children of nodes
+	std::unique_ptr<TaskPool> child_pool;  // the thread it plans on
+	if (parallel_children)
+	{
+		child_planner.reset(new ICBSSearch(*this));
+		child_pool.reset(new TaskPool(1));
+	}
 
 	while (!focal_list.empty()) 
 	{
 		runtime = std::clock() - start;
 		wall_runtime = std::chrono::system_clock::now() - wall_start;
-		if (runtime > time_limit * CLOCKS_PER_SEC)  // timeout
+		if (timedOut() || cancelled() || bfBudgetExhausted())
 		{
 			break;
 		}
@@ -1645,7 +3107,7 @@ bool ICBSSearch::runICBSSearch()
 		open_list.erase(curr->open_handle);
 
 		// get current solutions
-		populatePaths(curr, paths);
+		switchPaths(curr);
 
 		if (curr->partialExpansion)
 		{
@@ -1660,11 +3122,11 @@ bool ICBSSearch::runICBSSearch()
 			if ( screen == 1)
 				printConflicts(*curr);
 		}
-		else if (curr->conflict == NULL) //CBSH, and h value has not been computed yet
+		else if (curr->conflict == NO_CONFLICT) //CBSH, and h value has not been computed yet
 		{					
 			curr->conflict = classifyConflicts(*curr, paths); // classify and choose conflicts
 
-			curr->h_val = computeHeuristics(*curr);
+			curr->h_val = computeHeuristics(*curr, paths);
 			curr->f_val = curr->g_val + curr->h_val;
 
 			if (screen == 1)
@@ -1683,7 +3145,7 @@ bool ICBSSearch::runICBSSearch()
 			}
 		}
 
-		if (curr->conflict == NULL) // Failed to find a conflict => no conflicts
+		if (curr->conflict == NO_CONFLICT) // Failed to find a conflict => no conflicts
 		{  // found a solution (and finish the while loop)
 			solution_found = true;
 			solution_cost = curr->g_val;
@@ -1702,36 +3164,26 @@ bool ICBSSearch::runICBSSearch()
 			for (int i = 0; i < num_of_agents; i++)
 				std::cout << paths[i]->size() - 1 << ", ";
 			std::cout << ")" << std::endl;
-			std::cout << "Chose conflict " << (*curr->conflict) << std::endl;
-		}
-
-		if (split == split_strategy::DISJOINT3)
-		{
-//			ICBSNode* n1 = new ICBSNode(curr);
-//			ICBSNode* n2 = new ICBSNode(curr);
-//			ICBSNode* n3 = new ICBSNode(curr);
-//			auto [agent1_id, agent2_id, location1, location2, timestep] = *curr->conflict;
-//			n1->agent_id = agent1_id;
-//			n2->agent_id = agent2_id;
-//			n3->agent_id = (1 + agent1_id) * num_of_agents + agent2_id;
-//			if (location2 < 0) // vertex conflict
-//			{
-//				LL_num_generated += n1->add_constraint(make_tuple(location1, -1, timestep, true));
-//				LL_num_generated += n2->add_constraint(make_tuple(location1, -1, timestep, true));
-//				LL_num_generated += n3->add_constraint(make_tuple(location1, -1, timestep, false));
-//			}
-//			else // edge conflict
-//			{
-//				LL_num_generated += n1->add_constraint(make_tuple(location1, location2, timestep, true));
-//				LL_num_generated += n2->add_constraint(make_tuple(location2, location1, timestep, true));
-//				LL_num_generated += n3->add_constraint(make_tuple(location1, location2, timestep, false));
-//			}
-//			vector<vector<PathEntry>*> copy(paths);
-//			bool Sol1 = generateChild(n1);
-//			paths = copy;
-//			bool Sol2 = generateChild(n2);
-//			paths = copy;
-//			bool Sol3 = generateChild(n3);
+			std::cout << "Chose conflict " << conflict_pool[curr->conflict] << std::endl;
+		}
+
+		if (split == split_strategy::DISJOINT3 && isVertexOrEdgeConflict(conflict_pool[curr->conflict]))
+			generateDisjoint3Children(curr);
+		else if (shouldMerge(curr))
+		{
+			ICBSNode* n = new ICBSNode(curr);
+			bool success = planMergedChild(curr, n, paths);
+			if (success)
+				pushNode(n);
+			restorePaths();
+			if (screen == 1)
+			{
+				if (success)
+					std::cout << "Generated merged child #" << n->time_generated << " with cost " << n->g_val
+					          << " and " << n->num_of_conflicts << " conflicts " << std::endl;
+				else
+					std::cout << "No feasible solution for the merged child! " << std::endl;
+			}
 		}
 		else
 		{
@@ -1741,8 +3193,40 @@ bool ICBSSearch::runICBSSearch()
 			branch(curr, n1, n2); // add constraints to child nodes
 
 			bool success1 = false, success2 = false;
-			vector<vector<PathEntry>*> temp(paths);
-			success1 = generateChild(n1, paths); // plan paths for n1
+			if (child_planner != nullptr || bypass)
+			{
+				if (child_planner != nullptr)
+				{
+					// Plan the right child on the planner's thread with its own copy of the paths while this thread
+					// plans the left one
+					child_planner->paths = paths;
+					child_planner->replanned_agents.clear();
+					child_pool->submit([&](int) { success2 = child_planner->planChild(n2, child_planner->paths); });
+					success1 = planChild(n1, paths);
+					child_pool->wait();
+					restorePaths();
+				}
+				else  // Plan both children before adding them to OPEN, in case one of them can replace the node
+				{
+					success1 = planChild(n1, paths);
+					restorePaths();
+					success2 = planChild(n2, paths);
+					restorePaths();
+				}
+				if (bypass && bypassConflict(curr, success1 ? n1 : nullptr, success2 ? n2 : nullptr))
+				{
+					if (screen == 1)
+						std::cout << "Bypassed the conflict with the paths of a child" << std::endl;
+					continue;
+				}
+				// Add them to OPEN in the same order as below
+				if (success1)
+					pushNode(n1);
+				if (success2)
+					pushNode(n2);
+			}
+			else
+				success1 = generateChild(n1, paths); // plan paths for n1
 			if (screen == 1) {
 				if (success1) {
 					std::cout << "Generated left child #" << n1->time_generated
@@ -1752,58 +3236,371 @@ bool ICBSSearch::runICBSSearch()
 					std::cout << "No feasible solution for left child! " << std::endl;
 				}
 			}
-			paths = temp;
-			success2 = generateChild(n2, paths); // plan paths for n2
+			if (child_planner == nullptr && !bypass)
+			{
+				restorePaths();
+				success2 = generateChild(n2, paths); // plan paths for n2
+				restorePaths();
+			}
+
+			if (screen == 1)
+			{
+				if (success2)
+				{
+					std::cout << "Generated right child #" << n2->time_generated
+							  << " with cost " << n2->g_val
+							  << " and " << n2->num_of_conflicts << " conflicts " << std::endl;
+				}
+				else
+				{
+					std::cout << "No feasible solution for right child! " << std::endl;
+				}
+			}
+		}
+		curr->clear();
+		if (open_list.size() == 0) 
+		{
+			solution_found = false;
+			break;
+		}
+		ICBSNode* open_head = open_list.top();
+		if (open_head->f_val > min_f_val) 
+		{
+			if (screen == 1)
+				cout << "  Note -- FOCAL UPDATE!! from |FOCAL|=" << focal_list.size() 
+					<< " with |OPEN|=" << open_list.size() << " to |FOCAL|=";
+
+			min_f_val = open_head->f_val;
+			double new_focal_list_threshold = min_f_val * focal_w;
+			updateFocalList(focal_list_threshold, new_focal_list_threshold, focal_w);
+			focal_list_threshold = new_focal_list_threshold;
+			if (screen == 1)
+				cout << focal_list.size() << endl;
+
+		}
+		if (screen == 1)
+			cout << " ; (after) " << focal_list_threshold << endl << endl;
+	}  // end of while loop
+
+	if (child_planner != nullptr)
+		addStatistics(*child_planner);
+	runtime = std::clock() - start; //  get time
+	wall_runtime = std::chrono::system_clock::now() - wall_start;
+	highLevelTime = runtime - lowLevelTime;
+	wall_highLevelTime = wall_runtime - wall_lowLevelTime;
+	printPaths(paths);
+	return solution_found;
+}
+
+// Expand CT nodes with num_threads workers that share OPEN and FOCAL.
+// A conflict-free node doesn't end the search right away, since the nodes other workers are expanding may have lower
+// f-values than it. It's kept as the incumbent until no node in OPEN or being expanded can lead to a cheaper solution.
+bool ICBSSearch::runParallelICBSSearch(std::clock_t start, std::chrono::system_clock::time_point wall_start)
+{
+	vector<std::unique_ptr<ICBSSearch>> workers;
+	for (int i = 0; i < num_threads; i++)
+		workers.emplace_back(new ICBSSearch(*this));
+	vector<std::thread> threads;
+	for (auto& worker : workers)
+		threads.emplace_back(&ICBSSearch::expandNodes, worker.get(), wall_start);
+	for (auto& thread : threads)
+		thread.join();
+	for (const auto& worker : workers)
+		addStatistics(*worker);
+
+	runtime = std::clock() - start; //  get time (of all the threads)
+	wall_runtime = std::chrono::system_clock::now() - wall_start;
+	highLevelTime = runtime - lowLevelTime;
+	wall_highLevelTime = wall_runtime - wall_lowLevelTime;
+	if (solution_found)
+		populatePaths(incumbent, paths);
+	printPaths(paths);
+	return solution_found;
+}
+
+// The loop of a worker of a parallel best-first search: pop a node from the master's FOCAL, then classify its
+// conflicts, compute its heuristic and expand it like runICBSSearch does, with the worker's own paths and low-level
+// search engines.
+// Expanded nodes are never freed during the search, so the paths of ancestors stay valid while workers use them.
+// Workers expanding siblings may fill in the MDD fields of a path they share at the same time - with the same values.
+void ICBSSearch::expandNodes(std::chrono::system_clock::time_point wall_start)
+{
+	ICBSSearch& search = *master;
+	while (true)
+	{
+		ICBSNode* curr;
+		{
+			std::unique_lock<std::mutex> lock(search.frontier_mutex);
+			// Wait for a node to expand, or until no worker can generate one
+			search.frontier_changed.wait(lock, [&search] {
+				return search.search_done || !search.focal_list.empty() || search.expanding_f_vals.empty();
+			});
+			if (search.search_done)
+				return;
+			if (std::chrono::system_clock::now() - wall_start > std::chrono::seconds(time_limit) ||  // timeout
+			    cancelled() || search.bfBudgetExhausted())
+			{
+				search.search_done = true;
+				search.frontier_changed.notify_all();
+				return;
+			}
+			if (search.focal_list.empty())  // OPEN is empty and no worker is expanding a node
+			{
+				search.acceptIncumbentIfProven();
+				search.search_done = true;
+				search.frontier_changed.notify_all();
+				return;
+			}
+
+			// pop the best node from FOCAL
+			curr = search.focal_list.top();
+			search.focal_list.pop();
+			search.open_list.erase(curr->open_handle);
+			search.expanding_f_vals.insert(curr->f_val);
+		}
+		int expanding_f_val = curr->f_val;
+
+		// Stop expanding the node and put it back in OPEN if its f-value grew past FOCAL's threshold
+		auto reinsert = [&]() {
+			std::lock_guard<std::mutex> lock(search.frontier_mutex);
+			search.expanding_f_vals.erase(search.expanding_f_vals.find(expanding_f_val));
+			if (search.reinsert(curr))
+			{
+				search.frontier_changed.notify_all();
+				return true;
+			}
+			expanding_f_val = curr->f_val;
+			search.expanding_f_vals.insert(expanding_f_val);
+			return false;
+		};
+		// Done with the node - the lower bound may rise past it
+		auto finishExpanding = [&]() {
+			std::lock_guard<std::mutex> lock(search.frontier_mutex);
+			search.expanding_f_vals.erase(search.expanding_f_vals.find(expanding_f_val));
+			search.updateLowerBound();
+			search.acceptIncumbentIfProven();
+			search.frontier_changed.notify_all();
+		};
+
+		// get current solutions
+		switchPaths(curr);
+
+		if (curr->partialExpansion)
+		{
+			if (!finishPartialExpansion(curr, paths))
+			{
+				finishExpanding();
+				continue;
+			}
+			if (reinsert())
+				continue;
+		}
+		if (!HL_heuristic) // No heuristics
+			curr->conflict = classifyConflicts(*curr, paths); // choose conflict
+		else if (curr->conflict == NO_CONFLICT) //CBSH, and h value has not been computed yet
+		{
+			curr->conflict = classifyConflicts(*curr, paths); // classify and choose conflicts
+			curr->h_val = computeHeuristics(*curr, paths);
+			curr->f_val = curr->g_val + curr->h_val;
+			if (reinsert())
+				continue;
+		}
 
-			if (screen == 1)
+		if (curr->conflict == NO_CONFLICT) // Failed to find a conflict => no conflicts
+		{
 			{
-				if (success2)
-				{
-					std::cout << "Generated right child #" << n2->time_generated
-							  << " with cost " << n2->g_val
-							  << " and " << n2->num_of_conflicts << " conflicts " << std::endl;
-				}
-				else
-				{
-					std::cout << "No feasible solution for right child! " << std::endl;
-				}
+				std::lock_guard<std::mutex> lock(search.frontier_mutex);
+				if (search.incumbent == nullptr || curr->g_val < search.incumbent->g_val)
+					search.incumbent = curr;
 			}
+			finishExpanding();
+			continue;
 		}
-		curr->clear();
-		if (open_list.size() == 0) 
+
+		// Expand the node
 		{
-			solution_found = false;
-			break;
+			std::lock_guard<std::mutex> lock(search.frontier_mutex);
+			search.HL_num_expanded++;
+			curr->time_expanded = search.HL_num_expanded;
 		}
-		ICBSNode* open_head = open_list.top();
-		if (open_head->f_val > min_f_val) 
+		if (split == split_strategy::DISJOINT3 && isVertexOrEdgeConflict(conflict_pool[curr->conflict]))
+			generateDisjoint3Children(curr);
+		else
 		{
-			if (screen == 1)
-				cout << "  Note -- FOCAL UPDATE!! from |FOCAL|=" << focal_list.size() 
-					<< " with |OPEN|=" << open_list.size() << " to |FOCAL|=";
+			ICBSNode* n1 = new ICBSNode(curr);
+			ICBSNode* n2 = new ICBSNode(curr);
 
-			min_f_val = open_head->f_val;
-			double new_focal_list_threshold = min_f_val * focal_w;
-			updateFocalList(focal_list_threshold, new_focal_list_threshold, focal_w);
-			focal_list_threshold = new_focal_list_threshold;
-			if (screen == 1)
-				cout << focal_list.size() << endl;
+			branch(curr, n1, n2); // add constraints to child nodes
 
+			generateChild(n1, paths); // plan paths for n1
+			restorePaths();
+			generateChild(n2, paths); // plan paths for n2
+			restorePaths();
 		}
-		if (screen == 1)
-			cout << " ; (after) " << focal_list_threshold << endl << endl;
-	}  // end of while loop
+		curr->clear();
+		finishExpanding();
+	}
+}
 
-	runtime = std::clock() - start; //  get time
-	wall_runtime = std::chrono::system_clock::now() - wall_start;
-	highLevelTime = runtime - lowLevelTime;
-	wall_highLevelTime = wall_runtime - wall_lowLevelTime;
-	printPaths(paths);
-	return solution_found;
+// Conflict bypassing: if a child found paths of the same cost as the node's with fewer conflicts, the node adopts them
+// instead of branching. The children (nullptr for one that wasn't generated) are deleted, and the node goes back to OPEN
+// to have its conflicts classified again.
+// Assumes the paths vector was switched to the node. The root is never bypassed, since its paths are the initial
+// paths other searches and workers point at.
+bool ICBSSearch::bypassConflict(ICBSNode *curr, ICBSNode *n1, ICBSNode *n2)
+{
+	if (curr->parent == nullptr)
+		return false;
+	ICBSNode* helpful = nullptr;
+	for (ICBSNode* child : {n1, n2})
+		if (child != nullptr && !child->partialExpansion && child->g_val == curr->g_val &&
+		    child->num_of_conflicts < (helpful != nullptr ? helpful : curr)->num_of_conflicts)
+			helpful = child;
+	if (helpful == nullptr)
+		return false;
+
+	// Move the child's paths to the node, in front of the node's own paths for the same agents.
+	// The node's old paths are kept, so the addresses occupancy indices know paths by are never reused.
+	undoPathsOf(curr);
+	while (!helpful->new_paths.empty())
+	{
+		int ag = helpful->new_paths.front().first;
+		auto it = curr->new_paths.begin();
+		while (it != curr->new_paths.end() && it->first < ag)
+			++it;
+		curr->new_paths.splice(it, helpful->new_paths, helpful->new_paths.begin());
+	}
+	applyPathsOf(curr);
+	curr->makespan = helpful->makespan;
+	curr->cardinalConf = std::move(helpful->cardinalConf);
+	curr->semiConf = std::move(helpful->semiConf);
+	curr->nonConf = std::move(helpful->nonConf);
+	curr->unknownConf = std::move(helpful->unknownConf);
+	curr->num_of_conflicts = helpful->num_of_conflicts;
+	curr->conflict = NO_CONFLICT;
+
+	for (ICBSNode* child : {n1, n2})
+	{
+		if (child == nullptr)
+			continue;
+		for (int ag = 0; ag < num_of_agents; ag++)
+			if (child->lpas[ag] != curr->lpas[ag])
+				delete child->lpas[ag];  // The child's own copy
+		delete child;
+	}
+	curr->open_handle = open_list.push(curr);
+	if (curr->f_val <= focal_list_threshold)
+		curr->focal_handle = focal_list.push(curr);
+	HL_num_bypassed++;
+	return true;
+}
+
+// Add the statistics of a worker of a parallel search to this search's
+void ICBSSearch::addStatistics(const ICBSSearch& worker)
+{
+	lowLevelTime += worker.lowLevelTime;
+	highLevelMddBuildingTime += worker.highLevelMddBuildingTime;
+	wall_mddTime += worker.wall_mddTime;
+	wall_lowLevelTime += worker.wall_lowLevelTime;
+	LL_num_expanded += worker.LL_num_expanded;
+	LL_num_generated += worker.LL_num_generated;
+	HL_num_reexpanded += worker.HL_num_reexpanded;
+	wdg_num_subproblems += worker.wdg_num_subproblems;
+	wdg_num_cache_hits += worker.wdg_num_cache_hits;
+	mdd_cache_hits += worker.mdd_cache_hits;
+	mdd_cache_misses += worker.mdd_cache_misses;
+	mdd_cache_saved_time += worker.mdd_cache_saved_time;
+	mdd_num_incremental_updates += worker.mdd_num_incremental_updates;
+	mdd_num_from_lpa += worker.mdd_num_from_lpa;
+	mdd_num_windowed += worker.mdd_num_windowed;
+	num_rectangle_splits += worker.num_rectangle_splits;
+	num_corridor_splits += worker.num_corridor_splits;
+	num_target_splits += worker.num_target_splits;
+	num_mutex_cardinal += worker.num_mutex_cardinal;
+	num_mutex_splits += worker.num_mutex_splits;
+	num_merges += worker.num_merges;
+}
+
+// The resident memory of the process, in kB
+static size_t residentMemoryKB()
+{
+	std::ifstream statm("/proc/self/statm");
+	size_t size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Whether the best-first part of a hybrid search used up its budget. The resident memory is only read every 256
+// generated nodes.
+bool ICBSSearch::bfBudgetExhausted()
+{
+	if (!hybrid)
+		return false;
+	if (bf_node_budget > 0 && HL_num_generated >= bf_node_budget)
+		bf_budget_exhausted = true;
+	else if (bf_memory_budget_kb > 0 && HL_num_generated >= next_memory_check)
+	{
+		next_memory_check = HL_num_generated + 256;
+		bf_budget_exhausted = residentMemoryKB() >= bf_memory_budget_kb;
+	}
+	return bf_budget_exhausted;
+}
+
+// RUN a hybrid search: best-first CBSH until it generates bf_node_budget CT nodes or the resident memory of the
+// process reaches bf_memory_budget_kb, then ID-CBSH from the root, with the lowest f-value the best-first search left
+// in OPEN as its first threshold. The CT of the best-first search is freed before ID-CBSH starts.
+bool ICBSSearch::runHybridICBSSearch()
+{
+	std::clock_t start = std::clock();
+	auto wall_start = std::chrono::system_clock::now();
+	vector<LPAStar*> root_lpas = root_node->lpas;  // Expanding the root drops them, and ID-CBSH needs them
+	hybrid = true;
+	bool solved = runICBSSearch();
+	hybrid = false;
+	if (solved || !bf_budget_exhausted || cancelled())
+		return solved;
+
+	int lower_bound = lowestFVal();
+	hybrid_switch_generated = HL_num_generated;
+	if (screen)
+		std::cout << "Best-first budget exhausted after " << HL_num_generated << " CT nodes with a lower bound of "
+		          << lower_bound << ". Switching to ID-CBSH." << std::endl;
+	dropCTForIDCBSH(root_lpas);
+
+	return runIterativeDeepeningICBSSearch(lower_bound, start, wall_start);  // with the rest of the time limit
+}
+
+// Free every CT node but the root, with the LPA* instances they created, and restore the root to how ID-CBSH expects
+// to find it
+void ICBSSearch::dropCTForIDCBSH(const vector<LPAStar*>& root_lpas)
+{
+	switchPaths(root_node);
+	for (ICBSNode* node : allNodes_table)
+		if (node != root_node)
+			delete node;
+	for (LPAStar* lpa : lpa_copies)
+		delete lpa;
+	lpa_copies.clear();
+	allNodes_table.clear();
+	allNodes_table.push_back(root_node);
+	open_list.clear();
+	focal_list.clear();
+	paths_node = nullptr;
+	path_versions.clear();
+
+	root_node->clear();
+	root_node->lpas = root_lpas;
+	root_node->conflict = NO_CONFLICT;
+	findConflicts(*root_node);
+	root_node->num_of_conflicts = (int) root_node->unknownConf.size() + (int) root_node->cardinalConf.size() +
+	                              (int) root_node->semiConf.size() + (int) root_node->nonConf.size();
 }
 
 // RUN ID-CBS/LPA*
-bool ICBSSearch::runIterativeDeepeningICBSSearch()
+// min_threshold is a lower bound on the cost of the solution that's known in advance.
+// The time limit and the runtime are counted from the given start.
+bool ICBSSearch::runIterativeDeepeningICBSSearch(int min_threshold, std::clock_t start,
+                                                 std::chrono::system_clock::time_point wall_start)
 {
 	if (HL_heuristic)
 #ifndef LPA
@@ -1817,9 +3614,8 @@ bool ICBSSearch::runIterativeDeepeningICBSSearch()
 #else
 		std::cout << "ID-ICBS/LPA*: " << std::endl;
 #endif
-	// set timer
-	std::clock_t start = std::clock();
-	auto wall_start = std::chrono::system_clock::now();
+	if (!in_portfolio)  // The members of a portfolio share a cache, set up before they start
+		mdd_cache.max_bytes = mdd_cache_max_bytes;
 
 	vector<vector<PathEntry>*> the_paths;
 	the_paths.resize(num_of_agents, NULL);
@@ -1838,7 +3634,7 @@ bool ICBSSearch::runIterativeDeepeningICBSSearch()
 
 	// Compute the root node's h value, to be used for setting the first iteration's threshold:
 	if (HL_heuristic) {
-		root_node->h_val = computeHeuristics(*root_node);
+		root_node->h_val = computeHeuristics(*root_node, the_paths);
 		if (screen == 1) {
 			std::cout << std::endl << "****** Computed h for #" << root_node->time_generated
 					  << " with f= " << root_node->g_val << "+" << root_node->h_val << " (";
@@ -1855,13 +3651,17 @@ bool ICBSSearch::runIterativeDeepeningICBSSearch()
 	root_node->f_val = root_node->g_val + root_node->h_val;
 
 	// Set the first threshold
-	int threshold = root_node->f_val;
+	int threshold = max(root_node->f_val, min_threshold);
+	id_lower_bound = threshold;
+	id_upper_bound = std::numeric_limits<int>::max();
+	id_node_budget = 0;
+	id_iterations.clear();
 
 	while (true)
 	{
 		runtime = std::clock() - start;
 		wall_runtime = std::chrono::system_clock::now() - wall_start;
-		if (runtime > time_limit * CLOCKS_PER_SEC)  // timeout
+		if (timedOut() || cancelled())
 		{
 			break;
 		}
@@ -1873,10 +3673,26 @@ bool ICBSSearch::runIterativeDeepeningICBSSearch()
 		HL_num_expanded_before_this_iteration = HL_num_expanded;
 		HL_num_generated_before_this_iteration = HL_num_generated;
 		HL_num_generated_before_this_iteration--;  // Simulate that the root node was generated for this iteration
-		auto [solved, next_threshold] = do_idcbsh_iteration(root_node, the_paths, root_cat,
-    	                                                    threshold, std::numeric_limits<int>::max(),
-    	                                                    start + time_limit * CLOCKS_PER_SEC);
-		if (solved)
+		wall_end_by = wall_start + std::chrono::seconds(time_limit);
+		id_cut_off_f_vals.clear();
+		auto [solved, next_threshold] = num_threads > 1 ?
+			do_parallel_idcbsh_iteration(the_paths, threshold) :
+			do_idcbsh_iteration(root_node, the_paths, root_cat,
+			                    threshold, std::numeric_limits<int>::max(),
+			                    start + time_limit * CLOCKS_PER_SEC);
+		id_iterations.emplace_back(threshold, HL_num_expanded - start_expanded);
+		if (!solved && id_upper_bound != std::numeric_limits<int>::max() &&
+		    !idcbshStopped(start + time_limit * CLOCKS_PER_SEC))
+		{
+			// The iteration finished without finding a solution cheaper than the incumbent, so it's optimal.
+			// The root's paths are the_paths again - overwrite them with the incumbent's.
+			for (int i = 0; i < num_of_agents; i++)
+				*the_paths[i] = solution_paths[i];
+			solution_found = true;
+			min_f_val = solution_cost;  // Just to shut a focal list feasibility test up
+			solved = true;
+		}
+		if (solved || cancelled())
 			break;
 		if (screen)  // TODO: Use a high glog instead
 			std::cout << "Finished threshold " << threshold << ". Expanded " << HL_num_expanded - start_expanded <<
@@ -1887,11 +3703,9 @@ bool ICBSSearch::runIterativeDeepeningICBSSearch()
 		}
 
 		if (screen) {
-            for (const auto &agent_neg_constraints: root_node->negative_constraints) {
-                if (agent_neg_constraints.size() != 0) {
-                    std::cout << "IDCBS root has constraints at end of threshold " << threshold << "!" << std::endl;
-                    std::abort();
-                }
+            if (!root_node->constraints.empty()) {
+                std::cout << "IDCBS root has constraints at end of threshold " << threshold << "!" << std::endl;
+                std::abort();
             }
             for (auto lpa: root_node->lpas) {
                 for (const auto &dyn_constraints_for_timestep : lpa->dcm.dyn_constraints_) {
@@ -1904,7 +3718,8 @@ bool ICBSSearch::runIterativeDeepeningICBSSearch()
             }
         }
 
-		threshold = next_threshold;
+		id_lower_bound = next_threshold;
+		threshold = nextIDCBSHThreshold(next_threshold, HL_num_expanded - start_expanded);
 	}  // end of while loop
 
 	runtime = std::clock() - start; //  get time
@@ -1918,11 +3733,36 @@ bool ICBSSearch::runIterativeDeepeningICBSSearch()
 
 std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vector<PathEntry> *> &the_paths,
                                                       vector<unordered_map<int, AvoidanceState >> &the_cat,
-                                                      int threshold, int next_threshold, clock_t end_by) {
-	if (std::clock() > end_by)  // timeout (no need to unconstrain)
+                                                      int threshold, int next_threshold, clock_t end_by,
+                                                      int depth) {
+	if (idcbshStopped(end_by))  // timeout, or another worker found a solution (no need to unconstrain)
 	{
 		return make_tuple(false, next_threshold);
 	}
+	threshold = min(threshold, id_upper_bound - 1);  // Only look for solutions cheaper than the incumbent
+
+	// Look the node up in the transposition table
+	bool use_table = id_table_max_entries > 0 && master == nullptr && id_pool == nullptr;
+	size_t table_key = 0;
+	size_t table_check = 0;
+	bool in_table = false;
+	IDTableEntry entry{};
+	if (use_table)
+	{
+		std::tie(table_key, table_check) = hashConstraints(curr);
+		auto it = id_table.find(table_key);
+		if (it != id_table.end() && it->second.check == table_check)  // Otherwise it's another branch with the same key
+		{
+			in_table = true;
+			entry = it->second;
+		}
+	}
+	if (in_table && entry.bound > threshold)  // An earlier iteration proved there's no solution under it within the threshold
+	{
+		id_table_cutoffs++;
+		idcbshCutOff(entry.bound, next_threshold);
+		return make_tuple(false, next_threshold);  // The parent will unconstrain
+	}
 
 	if (!HL_heuristic) // Then conflicts are not yet classified
 	{
@@ -1930,11 +3770,28 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 
 		if (screen == 1)
 			printConflicts(*curr);
-	} else if (curr->conflict == nullptr) //CBSH, and h value has not been computed yet
+	} else if (curr->conflict == NO_CONFLICT) //CBSH, and h value has not been computed yet
 	{
 		curr->conflict = classifyConflicts(*curr, the_paths); // classify and choose conflicts
 
-		curr->h_val = computeHeuristics(*curr);
+		if (in_table)
+		{
+			id_table_hits++;
+			curr->h_val = entry.h_val;
+			// Split on the same conflict as the last visit, so the entries of the subtree stay relevant, if it's still
+			// a conflict of the node and as good a choice as the one classifyConflicts made
+			for (const vector<ConflictId>* confs : {&curr->cardinalConf, &curr->semiConf, &curr->nonConf})
+			{
+				if (std::find(confs->begin(), confs->end(), curr->conflict) != confs->end())
+				{
+					if (std::find(confs->begin(), confs->end(), entry.conflict) != confs->end())
+						curr->conflict = entry.conflict;
+					break;
+				}
+			}
+		}
+		else
+			curr->h_val = computeHeuristics(*curr, the_paths);
 		curr->f_val = curr->g_val + curr->h_val;
 
 		if (screen == 1) {
@@ -1950,19 +3807,43 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 			if (screen)
 				std::cout << "F value " << curr->f_val << " < " << threshold << " threshold. Backtracking." << std::endl;
 
-			next_threshold = min(next_threshold, curr->f_val);
+			if (use_table)
+				storeInIDTable(table_key, table_check, curr->h_val, curr->conflict, curr->f_val);
+			idcbshCutOff(curr->f_val, next_threshold);
 			return make_tuple(false, next_threshold);  // The parent will unconstrain
 		}
 	}
 
-	if (curr->conflict == NULL) // Failed to find a conflict => no conflicts => found a solution
+	if (curr->conflict == NO_CONFLICT) // Failed to find a conflict => no conflicts => found a solution
 	{
+		if (curr->g_val > id_lower_bound)  // The threshold grew past the lower bound - there may be a cheaper solution
+		{
+			id_upper_bound = curr->g_val;
+			solution_cost = curr->g_val;
+			solution_paths.resize(num_of_agents);
+			for (int i = 0; i < num_of_agents; i++)
+				solution_paths[i] = *the_paths[i];
+			if (screen)
+				std::cout << "Incumbent of cost " << curr->g_val << " found. Looking for a cheaper one." << std::endl;
+			next_threshold = min(next_threshold, curr->g_val);
+			return make_tuple(false, next_threshold);  // The parent will unconstrain
+		}
 		solution_found = true;
 		solution_cost = curr->g_val;
 		min_f_val = curr->f_val;  // Just to shut a focal list feasibility test up
+		if (master != nullptr)
+			master->id_stop = true;
+		else
+			id_stop = true;
 		return make_tuple(true, next_threshold);
 	}
 
+	if (id_pool != nullptr && depth == id_task_depth)  // Let a worker expand the node
+	{
+		spawnIDCBSHTask(curr, the_paths, the_cat, threshold, depth);
+		return make_tuple(false, next_threshold);
+	}
+
 	// Expand the node
 	HL_num_expanded++;
 	curr->time_expanded = HL_num_expanded - HL_num_expanded_before_this_iteration;
@@ -1974,12 +3855,21 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 		for (int i = 0; i < num_of_agents; i++)
 			std::cout << the_paths[i]->size() - 1 << ", ";
 		std::cout << ")" << std::endl;
-		std::cout << "Chosen conflict: " << *curr->conflict << std::endl;
+		std::cout << "Chosen conflict: " << conflict_pool[curr->conflict] << std::endl;
 	}
 
-	auto [agent1_id, agent2_id, location1, location2, timestep] = *curr->conflict;
+	if (split == split_strategy::DISJOINT3 && isVertexOrEdgeConflict(conflict_pool[curr->conflict]))
+	{
+		auto [success, lowest_avoided_f_val] = do_idcbsh_disjoint3_split(curr, the_paths, the_cat, threshold,
+		                                                                 next_threshold, end_by, depth);
+		if (!success && use_table)
+			storeInIDTable(table_key, table_check, curr->h_val, curr->conflict, lowest_avoided_f_val);
+		return make_tuple(success, lowest_avoided_f_val);
+	}
 
-	std::shared_ptr<Conflict> orig_conflict = curr->conflict;  // TODO: Consider not storing the conflict as a state of the node
+	auto [agent1_id, agent2_id, location1, location2, timestep] = conflict_pool[curr->conflict];
+
+	ConflictId orig_conflict = curr->conflict;  // TODO: Consider not storing the conflict as a state of the node
 	int orig_agent_id = curr->agent_id;
 	vector<PathEntry> path_backup = *the_paths[agent1_id];
 	int orig_makespan = curr->makespan;
@@ -2017,18 +3907,14 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 	if (replan1_success && curr->f_val <= threshold)
 	{
 		// Find the node's conflicts:
-		clearConflictsOfAgent(*curr, curr->agent_id);
-		for (int a2 = 0; a2 < num_of_agents; a2++) {
-			if (a2 != curr->agent_id)
-				findConflicts(the_paths, curr->agent_id, a2, *curr);
-		}
+		findConflictsOfAgent(*curr, the_paths, curr->agent_id);
 		curr->num_of_conflicts = (int) curr->unknownConf.size() + (int) curr->cardinalConf.size() +
 								 (int) curr->semiConf.size() + (int) curr->nonConf.size();
-		curr->conflict = nullptr;  // Trigger computation of h in the recursive call
+		curr->conflict = NO_CONFLICT;  // Trigger computation of h in the recursive call
 
 		// Recurse!
 		auto [success, lowest_avoided_f_val] = do_idcbsh_iteration(curr, the_paths, the_cat,
-		                                                           threshold, next_threshold, end_by);
+		                                                           threshold, next_threshold, end_by, depth + 1);
 		next_threshold = min(next_threshold, lowest_avoided_f_val);  // lowest_avoided_f_val might actually be just the
 																	 // next_threshold we provided
 
@@ -2037,11 +3923,12 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 			return make_tuple(true, next_threshold);
 		} else {
 			curr->agent_id = agent1_id;  // The recursive call may have changed it, and it needs to be restored before unconstrain is called
+			threshold = min(threshold, id_upper_bound - 1);  // An incumbent may have been found under the left child
 		}
 	} else {
 		// A path was not found for the constrained agent in the left child, or the overall g was higher than the threshold
 		if (curr->f_val > threshold)  // The overall g was higher than the threshold
-			next_threshold = min(next_threshold, curr->f_val);
+			idcbshCutOff(curr->f_val, next_threshold);
 
 		if (screen == 1) {
 			if (!constraint1_added)
@@ -2091,18 +3978,14 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 	if (replan2_success && curr->f_val <= threshold)
 	{
 		// Find the node's conflicts:
-		clearConflictsOfAgent(*curr, curr->agent_id);
-		for (int a2 = 0; a2 < num_of_agents; a2++) {
-			if (a2 != curr->agent_id)
-				findConflicts(the_paths, curr->agent_id, a2, *curr);
-		}
+		findConflictsOfAgent(*curr, the_paths, curr->agent_id);
 		curr->num_of_conflicts = (int) curr->unknownConf.size() + (int) curr->cardinalConf.size() +
 								 (int) curr->semiConf.size() + (int) curr->nonConf.size();
-		curr->conflict = nullptr;  // Trigger computation of h in the recursive call
+		curr->conflict = NO_CONFLICT;  // Trigger computation of h in the recursive call
 
 		// Recurse!
 		auto [success, lowest_avoided_f_val] = do_idcbsh_iteration(curr, the_paths, the_cat,
-                                                                   threshold, next_threshold, end_by);
+                                                                   threshold, next_threshold, end_by, depth + 1);
 		next_threshold = min(next_threshold, lowest_avoided_f_val);
 
 		if (success) {
@@ -2113,10 +3996,15 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 			if (constraint2_added)
 				idcbsh_unconstrain(curr, the_paths, the_cat, path_backup, orig_conflict, orig_makespan, orig_g_val, orig_h_val);
 			curr->agent_id = orig_agent_id;  // Just to be clean
+			if (use_table)
+				storeInIDTable(table_key, table_check, orig_h_val, orig_conflict, next_threshold);
 			return make_tuple(false, next_threshold);
 		}
 	} else {
-		// A path was not found for the constrained agent in the left child, or the overall g was higher than the threshold
+		// A path was not found for the constrained agent in the right child, or the overall g was higher than the threshold
+		if (curr->f_val > threshold)  // The overall g was higher than the threshold
+			idcbshCutOff(curr->f_val, next_threshold);
+
 		if (screen == 1) {
 			if (!constraint2_added)
 				std::cout << "The right child's cost would have been larger than the NEXT threshold " <<
@@ -2132,20 +4020,316 @@ std::tuple<bool, int> ICBSSearch::do_idcbsh_iteration(ICBSNode *curr, vector<vec
 	if (constraint2_added)
 		idcbsh_unconstrain(curr, the_paths, the_cat, path_backup, orig_conflict, orig_makespan, orig_g_val, orig_h_val);
 	curr->agent_id = orig_agent_id;  // Just to be clean
+	// No solution within the threshold under the node. Every node the iteration cut off under it had an f-value of at
+	// least next_threshold, so no solution under it costs less.
+	if (use_table)
+		storeInIDTable(table_key, table_check, orig_h_val, orig_conflict, next_threshold);
+	return make_tuple(false, next_threshold);
+}
+
+// Expand the node with a DISJOINT3 split of its vertex or edge conflict, turning it into each of its three children in
+// place in turn, like do_idcbsh_iteration does with the two children of other splits. A child adds a landmark of one
+// agent and a negative constraint on the other, or negative constraints on both agents, and replans the agents with
+// the negative constraints. The node is restored after each child, unless a solution was found under it.
+std::tuple<bool, int> ICBSSearch::do_idcbsh_disjoint3_split(ICBSNode *curr, vector<vector<PathEntry> *> &the_paths,
+                                                            vector<unordered_map<int, AvoidanceState >> &the_cat,
+                                                            int threshold, int next_threshold, clock_t end_by,
+                                                            int depth)
+{
+	auto [agent1_id, agent2_id, location1, location2, timestep] = conflict_pool[curr->conflict];
+	ConflictId orig_conflict = curr->conflict;
+	int orig_agent_id = curr->agent_id;
+	int orig_makespan = curr->makespan;
+	int orig_g_val = curr->g_val;
+	int orig_h_val = curr->h_val;
+
+	// The agent with the landmark in each child (-1 for none), and the agents with the negative constraints
+	const int landmark_agents[3] = {agent1_id, agent2_id, -1};
+	const vector<int> constrained_agents[3] = {{agent2_id}, {agent1_id}, {agent1_id, agent2_id}};
+	struct Backup
+	{
+		vector<PathEntry> path;
+		int makespan;
+		int g_val;
+	};
+	for (int child = 0; child < 3; child++)
+	{
+		int landmark_agent = landmark_agents[child];
+		vector<PathEntry> landmark_path_backup;
+		if (landmark_agent >= 0)
+		{
+			// The agent's path already satisfies the landmark, but its MDD levels are narrower under it, and the ones
+			// built without it might say the cost can't increase when it must
+			landmark_path_backup = *the_paths[landmark_agent];
+			constrainAgentOfConflict(curr, curr, landmark_agent, true);
+			for (int t = 1; t < (int)the_paths[landmark_agent]->size(); t++)
+				the_paths[landmark_agent]->at(t).builtMDD = false;
+		}
+
+		// Replan the agents with the negative constraints one after the other. Each may only raise the cost up to
+		// the next threshold, given what the ones before it added.
+		vector<Backup> backups;
+		bool replan_success = true;
+		bool constraint_added = true;
+		for (int ag : constrained_agents[child])
+		{
+			backups.push_back(Backup{*the_paths[ag], curr->makespan, curr->g_val});
+			curr->agent_id = ag;
+			std::tie(replan_success, constraint_added) = idcbsh_add_constraint_and_replan(
+					curr, the_paths, the_cat, next_threshold - curr->g_val - 1);
+			if (!constraint_added)
+				backups.pop_back();
+			if (!replan_success)
+				break;
+		}
+		int g_delta = curr->g_val - orig_g_val;
+		// Subtract the g_delta from h, just to be nice:
+		curr->h_val = max(orig_h_val - g_delta, 0);
+		curr->f_val = curr->g_val + curr->h_val;
+
+		if (replan_success) {
+			HL_num_generated++;
+			curr->time_generated = HL_num_generated - HL_num_generated_before_this_iteration;
+			if (screen) {
+				// check the solution
+				arePathsConsistentWithConstraints(the_paths, curr);
+
+				// Print
+				std::cout << "Generated child #" << curr->time_generated
+						  << " with cost " << curr->g_val << std::endl;
+			}
+		}
+
+		if (replan_success && curr->f_val <= threshold)
+		{
+			// Find the node's conflicts, and classify the landmark agent's again:
+			if (landmark_agent >= 0)
+				findConflictsOfAgent(*curr, the_paths, landmark_agent);
+			for (int ag : constrained_agents[child])
+				findConflictsOfAgent(*curr, the_paths, ag);
+			curr->num_of_conflicts = (int) curr->unknownConf.size() + (int) curr->cardinalConf.size() +
+									 (int) curr->semiConf.size() + (int) curr->nonConf.size();
+			curr->conflict = NO_CONFLICT;  // Trigger computation of h in the recursive call
+
+			// Recurse!
+			auto [success, lowest_avoided_f_val] = do_idcbsh_iteration(curr, the_paths, the_cat,
+			                                                           threshold, next_threshold, end_by, depth + 1);
+			next_threshold = min(next_threshold, lowest_avoided_f_val);
+
+			if (success) {
+				curr->agent_id = orig_agent_id;  // Just to be clean
+				return make_tuple(true, next_threshold);
+			}
+			threshold = min(threshold, id_upper_bound - 1);  // An incumbent may have been found under the child
+		}
+		else
+		{
+			// A path was not found for a constrained agent, or the overall g was higher than the threshold
+			if (replan_success)
+				idcbshCutOff(curr->f_val, next_threshold);
+
+			if (screen == 1) {
+				if (!constraint_added)
+					std::cout << "The child's cost would have been larger than the NEXT threshold " <<
+							  next_threshold << "." << std::endl;
+				else if (!replan_success)
+					std::cout << "No solution for the child! " << std::endl;
+				else
+					std::cout << "The child's F value " << curr->f_val << " < " << threshold << " threshold." << std::endl;
+			}
+		}
+
+		// Undo the child. The agents' paths are restored in the reverse order they were replanned in.
+		for (int i = (int)backups.size() - 1; i >= 0; i--)
+		{
+			curr->agent_id = constrained_agents[child][i];
+			idcbsh_unconstrain(curr, the_paths, the_cat, backups[i].path, orig_conflict, backups[i].makespan,
+			                   backups[i].g_val, orig_h_val);
+		}
+		if (landmark_agent >= 0)
+		{
+			curr->agent_id = landmark_agent;
+			curr->pop_landmark();
+			*the_paths[landmark_agent] = landmark_path_backup;
+			// Its conflicts were classified by the MDD levels built under the landmark
+			findConflictsOfAgent(*curr, the_paths, landmark_agent);
+			curr->num_of_conflicts = (int) curr->unknownConf.size() + (int) curr->cardinalConf.size() +
+									 (int) curr->semiConf.size() + (int) curr->nonConf.size();
+			classifyConflicts(*curr, the_paths);
+			curr->conflict = orig_conflict;
+			curr->makespan = orig_makespan;
+			curr->g_val = orig_g_val;
+			curr->h_val = orig_h_val;
+			curr->f_val = curr->g_val + curr->h_val;
+		}
+	}
+	curr->agent_id = orig_agent_id;  // Just to be clean
+	// No solution within the threshold under the node
 	return make_tuple(false, next_threshold);
 }
 
+// Count a node the iteration cut off because its f-value was over the threshold
+void ICBSSearch::idcbshCutOff(int f_val, int& next_threshold)
+{
+	next_threshold = min(next_threshold, f_val);
+	if (growth != threshold_growth::MIN_EXCEEDED)
+		id_cut_off_f_vals[f_val]++;
+}
+
+// The threshold of the next ID-CBSH iteration, given the lowest f-value the last one cut off and the number of nodes
+// it expanded. Every cut-off node with an f-value up to the threshold is predicted to add at least one node to the next
+// iteration, so it's the lowest f-value with enough cut-off nodes up to it to reach the desired size.
+int ICBSSearch::nextIDCBSHThreshold(int lowest_cut_off_f_val, uint64_t expanded)
+{
+	if (growth == threshold_growth::MIN_EXCEEDED || num_threads > 1 || id_cut_off_f_vals.empty())
+		return lowest_cut_off_f_val;
+	double desired;
+	if (growth == threshold_growth::CR)
+		desired = growth_ratio * expanded;
+	else  // BUDGET
+	{
+		id_node_budget = growth_ratio * max(id_node_budget, (double)expanded);
+		desired = id_node_budget;
+	}
+	double predicted = expanded;
+	for (const auto& [f_val, count] : id_cut_off_f_vals)
+	{
+		predicted += count;
+		if (predicted >= desired)
+			return f_val;
+	}
+	return id_cut_off_f_vals.rbegin()->first;
+}
+
+void ICBSSearch::storeInIDTable(size_t key, size_t check, int h_val, ConflictId conflict, int bound)
+{
+	if (id_table.size() >= id_table_max_entries)
+		id_table.clear();
+	id_table[key] = IDTableEntry{check, h_val, conflict, bound};
+}
+
+// Whether to stop an ID-CBSH iteration. A parallel one is cut off by wall time, and is cancelled once any of its
+// workers found a solution.
+bool ICBSSearch::idcbshStopped(clock_t end_by) const
+{
+	const ICBSSearch& search = master != nullptr ? *master : *this;
+	if (cancelled())
+		return true;
+	if (search.num_threads > 1 || search.in_portfolio || search.runs_concurrently)
+		return search.id_stop || std::chrono::system_clock::now() > search.wall_end_by;
+	return std::clock() > end_by;
+}
+
+// Run an ID-CBSH iteration with num_threads workers. This thread expands the nodes above id_task_depth and hands each
+// node at that depth to the pool, then waits for the workers to finish.
+// Since the subtrees are independent, any solution a worker finds within the threshold is optimal, like the first
+// one a sequential iteration finds.
+std::tuple<bool, int> ICBSSearch::do_parallel_idcbsh_iteration(vector<vector<PathEntry> *> &the_paths, int threshold)
+{
+	// Enough subtrees to keep all the threads busy even when most of them are pruned quickly
+	id_task_depth = 2;
+	while ((1 << (id_task_depth - 2)) < num_threads)
+		id_task_depth++;
+	id_next_threshold = std::numeric_limits<int>::max();
+	id_stop = false;
+	for (int i = 0; i < num_threads; i++)
+	{
+		id_workers.emplace_back(new ICBSSearch(*this));
+		id_workers.back()->HL_num_expanded_before_this_iteration = HL_num_expanded_before_this_iteration;
+		id_workers.back()->HL_num_generated_before_this_iteration = HL_num_generated_before_this_iteration;
+	}
+	id_pool.reset(new TaskPool(num_threads));
+
+	auto [solved, next_threshold] = do_idcbsh_iteration(root_node, the_paths, root_cat, threshold,
+	                                                    std::numeric_limits<int>::max(),
+	                                                    std::numeric_limits<clock_t>::max());
+	id_pool.reset();  // Waits for the workers
+	next_threshold = min(next_threshold, id_next_threshold.load());
+
+	for (const auto& worker : id_workers)
+	{
+		addStatistics(*worker);
+		HL_num_expanded += worker->HL_num_expanded;
+		HL_num_generated += worker->HL_num_generated;
+		if (worker->solution_found && !solved)
+		{
+			// This thread unconstrained its own node while backtracking - report the paths of the worker's
+			solved = true;
+			solution_found = true;
+			solution_cost = worker->solution_cost;
+			min_f_val = worker->min_f_val;
+			for (int i = 0; i < num_of_agents; i++)
+				*the_paths[i] = worker->solution_paths[i];
+		}
+	}
+	id_workers.clear();
+	return make_tuple(solved, next_threshold);
+}
+
+// Hand the subtree of the node to a worker, with copies of the state ID-CBSH changes in place
+void ICBSSearch::spawnIDCBSHTask(const ICBSNode *curr, const vector<vector<PathEntry> *> &the_paths,
+                                 const vector<unordered_map<int, AvoidanceState >> &the_cat, int threshold, int depth)
+{
+	auto node = std::make_shared<ICBSNode>(*curr);
+	for (auto& lpa : node->lpas)
+		if (lpa != nullptr)
+			lpa = new LPAStar(*lpa);
+	auto task_paths = std::make_shared<vector<vector<PathEntry> *>>(num_of_agents);
+	for (int i = 0; i < num_of_agents; i++)
+		(*task_paths)[i] = new vector<PathEntry>(*the_paths[i]);
+	auto cat = std::make_shared<vector<unordered_map<int, AvoidanceState >>>(the_cat);
+	id_pool->submit([this, node, task_paths, cat, threshold, depth](int thread_index) {
+		id_workers[thread_index]->runIDCBSHTask(*node, *task_paths, *cat, threshold, depth);
+	});
+}
+
+// Search the subtree of a node a parallel ID-CBSH iteration handed to this worker, then free the copies it was given
+void ICBSSearch::runIDCBSHTask(ICBSNode &node, vector<vector<PathEntry> *> &the_paths,
+                               vector<unordered_map<int, AvoidanceState >> &the_cat, int threshold, int depth)
+{
+	if (!idcbshStopped(0))
+	{
+		occupancy_index.reset(num_of_agents);
+		for (int i = 0; i < num_of_agents; i++)
+			occupancy_index.addPath(i, the_paths[i]);
+		// The lowest f-value other workers found over the threshold is as good a bound for pruning as our own
+		auto [solved, next_threshold] = do_idcbsh_iteration(&node, the_paths, the_cat, threshold,
+		                                                    master->id_next_threshold,
+		                                                    std::numeric_limits<clock_t>::max(), depth);
+		int lowest = master->id_next_threshold;
+		while (next_threshold < lowest && !master->id_next_threshold.compare_exchange_weak(lowest, next_threshold));
+		if (solved)
+		{
+			solution_paths.resize(num_of_agents);
+			for (int i = 0; i < num_of_agents; i++)
+				solution_paths[i] = *the_paths[i];
+		}
+	}
+
+	for (auto path : the_paths)
+		delete path;
+	for (auto lpa : node.lpas)
+		delete lpa;
+}
+
 // Returns (replan_success, constraint_added)
 tuple<bool, bool> ICBSSearch::idcbsh_add_constraint_and_replan(ICBSNode *node, vector<vector<PathEntry> *> &the_paths,
                                                                vector<unordered_map<int, AvoidanceState >> &the_cat,
                                                                int allowed_cost_increase)
 {
-	auto [agent1_id, agent2_id, location1, location2, timestep] = *node->conflict;
+	auto [agent1_id, agent2_id, location1, location2, timestep] = conflict_pool[node->conflict];
 	bool costMayIncrease = true;
 	int oldG = node->g_val;
 
 	int minNewCost;
-	if (timestep >= (int)the_paths[node->agent_id]->size()) // Conflict happens after the agent reaches its goal.
+	if (isRectangleConflict(conflict_pool[node->conflict]) ||  // The barrier or range constraint won't lower the cost
+	    isCorridorConflict(conflict_pool[node->conflict]))
+		minNewCost = (int)the_paths[node->agent_id]->size() - 1;
+	else if (isTargetConflict(conflict_pool[node->conflict]))  // The path of the agent at its goal must end later
+		minNewCost = node->agent_id == agent1_id ? timestep + 1 : (int)the_paths[node->agent_id]->size() - 1;
+	else if (isMutexConflict(conflict_pool[node->conflict]))  // The constraints block a whole level of the agent's MDD
+		minNewCost = (int)the_paths[node->agent_id]->size();
+	else if (timestep >= (int)the_paths[node->agent_id]->size()) // Conflict happens after the agent reaches its goal.
 		// Since there can only be vertex conflicts when the agent is WAITing
 		// at its goal, the goal would only be reachable after the time of the new constraint
 		minNewCost = timestep + 1;
@@ -2173,7 +4357,36 @@ tuple<bool, bool> ICBSSearch::idcbsh_add_constraint_and_replan(ICBSNode *node, v
 	removePathFromConflictAvoidanceTable(the_paths[node->agent_id], the_cat);
 
 	// Constrain and replan
-	if (location2 < 0 || node->agent_id == agent1_id)
+	if (isRectangleConflict(conflict_pool[node->conflict]))
+	{
+		vector<Constraint> barrier;
+		getRectangleBarrier(conflict_pool[node->conflict], node->agent_id, barrier);
+		LL_num_generated += node->add_barrier(barrier, &the_cat, true);
+		timestep = std::get<2>(barrier.front());
+		num_rectangle_splits++;
+	}
+	else if (isCorridorConflict(conflict_pool[node->conflict]))
+	{
+		Constraint range = getCorridorConstraint(conflict_pool[node->conflict], node->agent_id);
+		LL_num_generated += node->add_constraint(range, &the_cat, true);
+		timestep = std::get<2>(range);
+		num_corridor_splits++;
+	}
+	else if (isTargetConflict(conflict_pool[node->conflict]))
+	{
+		LL_num_generated += node->add_constraint(getTargetConstraint(conflict_pool[node->conflict], node->agent_id),
+		                                         &the_cat, true);
+		num_target_splits++;
+	}
+	else if (isMutexConflict(conflict_pool[node->conflict]))
+	{
+		const vector<Constraint>& constraints = conflict_pool.mutexConstraints(conflict_pool[node->conflict],
+		                                                                       node->agent_id == agent1_id ? 0 : 1);
+		LL_num_generated += node->add_barrier(constraints, &the_cat, true);
+		timestep = std::get<2>(constraints.front());
+		num_mutex_splits++;
+	}
+	else if (location2 < 0 || node->agent_id == agent1_id)
 		LL_num_generated += node->add_constraint(make_tuple(location1, location2, timestep, false), &the_cat, true);
 	else
 		LL_num_generated += node->add_constraint(make_tuple(location2, location1, timestep, false), &the_cat, true);
@@ -2195,11 +4408,23 @@ tuple<bool, bool> ICBSSearch::idcbsh_add_constraint_and_replan(ICBSNode *node, v
 
 void ICBSSearch::idcbsh_unconstrain(ICBSNode *node, vector<vector<PathEntry> *> &the_paths,
                                     vector<unordered_map<int, AvoidanceState >> &the_cat,
-                                    vector<PathEntry> &path_backup, shared_ptr<Conflict> &conflict_backup,
+                                    vector<PathEntry> &path_backup, ConflictId conflict_backup,
                                     int makespan_backup, int g_val_backup, int h_val_backup)
 {
-	// Remove the last constraint on the agent
+	// Remove the last constraint on the agent, or its barrier
 	int agent_id = node->agent_id;
+	int num_constraints = 1;
+	if (isRectangleConflict(conflict_pool[conflict_backup]))
+	{
+		vector<Constraint> barrier;
+		getRectangleBarrier(conflict_pool[conflict_backup], agent_id, barrier);
+		num_constraints = (int)barrier.size();
+	}
+	else if (isMutexConflict(conflict_pool[conflict_backup]))
+	{
+		int i = agent_id == std::get<0>(conflict_pool[conflict_backup]) ? 0 : 1;
+		num_constraints = (int)conflict_pool.mutexConstraints(conflict_pool[conflict_backup], i).size();
+	}
 	std::vector<std::unordered_map<int, AvoidanceState>>* catp = nullptr;
 #ifndef LPA
 #else
@@ -2207,7 +4432,8 @@ void ICBSSearch::idcbsh_unconstrain(ICBSNode *node, vector<vector<PathEntry> *>
     removePathFromConflictAvoidanceTable(the_paths[agent_id], the_cat);
     catp = &the_cat;
 #endif
-	LL_num_generated += node->pop_constraint(catp);
+	for (int i = 0; i < num_constraints; i++)
+		LL_num_generated += node->pop_constraint(catp);
 #ifndef LPA
 #else
     // Restore the conflict-avoidance table to have the paths of all the agents
@@ -2223,11 +4449,7 @@ void ICBSSearch::idcbsh_unconstrain(ICBSNode *node, vector<vector<PathEntry> *>
 	}
 	// Find the conflicts again, we didn't save a backup of them.
 	// TODO: Consider doing that too.
-	clearConflictsOfAgent(*node, agent_id);
-	for (int a2 = 0; a2 < num_of_agents; a2++) {
-		if (a2 != agent_id)
-			findConflicts(the_paths, agent_id, a2, *node);
-	}
+	findConflictsOfAgent(*node, the_paths, agent_id);
 	node->num_of_conflicts = (int) node->unknownConf.size() + (int) node->cardinalConf.size() +
 							 (int) node->semiConf.size() + (int) node->nonConf.size();
 	classifyConflicts(*node, the_paths); // classify and choose conflicts
@@ -2242,7 +4464,8 @@ void ICBSSearch::idcbsh_unconstrain(ICBSNode *node, vector<vector<PathEntry> *>
 
 ICBSSearch::ICBSSearch(const MapLoader& ml, const AgentsLoader& al, double focal_w, split_strategy p, bool HL_h,
 					   int cutoffTime, int screen):
-	focal_w(focal_w), split(p), HL_heuristic(HL_h), screen(screen)
+	split(p), screen(screen), HL_heuristic(HL_h), focal_w(focal_w), shared(std::make_shared<SharedState>()),
+	conflict_pool(shared->conflict_pool), mdd_cache(shared->mdd_cache), wdg_cache(shared->wdg_cache)
 {
 	// set timer
 	std::clock_t start = std::clock();
@@ -2250,10 +4473,13 @@ ICBSSearch::ICBSSearch(const MapLoader& ml, const AgentsLoader& al, double focal
 
 	time_limit = cutoffTime;
 	this->num_map_cols = ml.cols;
+	corridors = ml.corridors;
+	corridor_of = ml.corridor_of;
 	num_of_agents = al.num_of_agents;
 	map_size = ml.rows * ml.cols;
 	moves_offset = ml.moves_offset;
 	search_engines = vector < ICBSSingleAgentLLSearch* >(num_of_agents);
+	occupancy_index.reset(num_of_agents);
 
 #ifndef LPA
 #else
@@ -2372,13 +4598,105 @@ ICBSSearch::ICBSSearch(const MapLoader& ml, const AgentsLoader& al, double focal
 	wall_prepTime = std::chrono::system_clock::now() - wall_start;
 }
 
+// A worker of the given search for parallel searches. It shares the search's CT, conflict pool and caches, and has
+// its own paths, occupancy index, low-level search engines and statistics.
+ICBSSearch::ICBSSearch(ICBSSearch& master):
+	split(master.split), HL_heuristic(master.HL_heuristic), master(&master), shared(master.shared),
+	conflict_pool(shared->conflict_pool), mdd_cache(shared->mdd_cache), wdg_cache(shared->wdg_cache)
+{
+	posConstraintsAlsoAddPosConstraintsOnMddNarrowLevelsLeadingToThem =
+		master.posConstraintsAlsoAddPosConstraintsOnMddNarrowLevelsLeadingToThem;
+	screen = master.screen;
+	heuristic_type = master.heuristic_type;
+	wdg_max_subproblem_nodes = master.wdg_max_subproblem_nodes;
+	wdg_max_cache_entries = master.wdg_max_cache_entries;
+	mdd_cache_max_bytes = master.mdd_cache_max_bytes;
+	mdd_window = master.mdd_window;
+	id_table_max_entries = master.id_table_max_entries;
+	rectangle_reasoning = master.rectangle_reasoning;
+	corridor_reasoning = master.corridor_reasoning;
+	target_reasoning = master.target_reasoning;
+	mutex_reasoning = master.mutex_reasoning;
+	merge_threshold = master.merge_threshold;
+	growth = master.growth;
+	growth_ratio = master.growth_ratio;
+	bypass = master.bypass;
+	focal_w = master.focal_w;
+	time_limit = master.time_limit;
+
+	map_size = master.map_size;
+	num_of_agents = master.num_of_agents;
+	moves_offset = master.moves_offset;
+	num_map_cols = master.num_map_cols;
+	corridors = master.corridors;
+	corridor_of = master.corridor_of;
+	root_node = master.root_node;
+	paths_found_initially = master.paths_found_initially;
+	paths.resize(num_of_agents, NULL);
+	occupancy_index.reset(num_of_agents);
+
+	// The low-level search engines keep the state of their last search, so each worker needs its own
+	search_engines.resize(num_of_agents);
+	for (int i = 0; i < num_of_agents; i++)
+	{
+		const ICBSSingleAgentLLSearch* engine = master.search_engines[i];
+		search_engines[i] = new ICBSSingleAgentLLSearch(engine->start_location, engine->goal_location, engine->my_map,
+		                                                engine->map_size / engine->num_col, engine->num_col,
+		                                                engine->moves_offset);
+		search_engines[i]->my_heuristic = engine->my_heuristic;
+		search_engines[i]->differential_h = engine->differential_h;
+	}
+}
+
+// Starts from a copy of the prototype's root node, with its own LPA* instances, but shares the prototype's
+// low-level heuristics and caches. The prototype itself isn't meant to be run.
+ICBSSearch::ICBSSearch(ICBSSearch& prototype, split_strategy p): ICBSSearch(prototype)
+{
+	master = nullptr;
+	split = p;
+	in_portfolio = true;
+	mdd_cache.max_bytes = mdd_cache_max_bytes;
+	for (int i = 0; i < num_of_agents; i++)
+	{
+		search_engines[i]->differential_h.clear();
+		if (split != split_strategy::NON_DISJOINT)
+			for (int j = 0; j < num_of_agents; j++)
+				search_engines[i]->differential_h.push_back(&search_engines[j]->my_heuristic);
+	}
+
+	root_node = new ICBSNode(*prototype.root_node);
+	for (auto& lpa : root_node->lpas)
+		if (lpa != nullptr)
+			lpa = new LPAStar(*lpa);
+	root_cat = prototype.root_cat;
+	for (int i = 0; i < num_of_agents; i++)
+	{
+		paths[i] = &paths_found_initially[i];
+		occupancy_index.addPath(i, paths[i]);
+	}
+	root_node->open_handle = open_list.push(root_node);
+	root_node->focal_handle = focal_list.push(root_node);
+	allNodes_table.push_back(root_node);
+	HL_num_generated = prototype.HL_num_generated;
+	LL_num_expanded = prototype.LL_num_expanded;
+	LL_num_generated = prototype.LL_num_generated;
+	lowLevelTime = prototype.lowLevelTime;
+	wall_lowLevelTime = prototype.wall_lowLevelTime;
+	prepTime = prototype.prepTime;
+	wall_prepTime = prototype.wall_prepTime;
+	min_f_val = prototype.min_f_val;
+	focal_list_threshold = prototype.focal_list_threshold;
+}
+
 ICBSSearch::~ICBSSearch()
 {
 	for (size_t i = 0; i < search_engines.size(); i++)
 		delete search_engines[i];
 
 	for (list<ICBSNode*>::iterator it = allNodes_table.begin(); it != allNodes_table.end(); it++) {
-		// TODO: free all the lpastar instances from all the nodes, but carefully, since they're shared
+		// TODO: free the root's lpastar instances too
 		delete *it;
 	}
+	for (LPAStar* lpa : lpa_copies)
+		delete lpa;
 }
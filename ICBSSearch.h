@@ -1,12 +1,22 @@
 // ICBS Search (High-level)
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_set>
 
 #include "ICBSNode.h"
 #include "ICBSSingleAgentLLSearch.h"
 #include "heuristic_calculator.h"
 #include "agents_loader.h"
+#include "occupancy_index.h"
+#include "mdd_cache.h"
+#include "mutex_propagation.h"
+#include "task_pool.h"
 
 class ICBSSearch
 {
@@ -16,8 +26,31 @@ public:
 	bool posConstraintsAlsoAddPosConstraintsOnMddNarrowLevelsLeadingToThem = false;
 	int screen = 0;
 	bool HL_heuristic;
+	heuristics_type heuristic_type = heuristics_type::CG;  // Which heuristic to compute when HL_heuristic is set
+	int wdg_max_subproblem_nodes = 64;  // CT nodes a 2-agent sub-problem may expand before settling for its lower bound
+	size_t wdg_max_cache_entries = 1 << 20;
+	size_t mdd_cache_max_bytes = 64 << 20;  // Memory budget of the MDD cache. 0 disables it.
+	int mdd_window = 0;  // Levels before and after a conflict to classify it by, instead of full MDDs. 0: full MDDs.
+	size_t id_table_max_entries = 1 << 20;  // Entries of the ID-CBSH transposition table. 0 disables it.
+	threshold_growth growth = threshold_growth::MIN_EXCEEDED;  // Of the ID-CBSH threshold. Single-threaded only.
+	double growth_ratio = 2;  // How much larger than the last one each ID-CBSH iteration should be, for CR and BUDGET
+	// Budget of the best-first part of a hybrid search, before it switches to ID-CBSH. 0: no limit.
+	uint64_t bf_node_budget = 0;  // CT nodes generated
+	size_t bf_memory_budget_kb = 0;  // resident memory of the process
 	double focal_w = 1.0;
 	int time_limit;
+	int num_threads = 1;  // Threads that expand CT nodes in parallel
+	bool parallel_children = false;  // Plan the two children of each node in parallel in a single-threaded runICBSSearch
+	bool bypass = false;  // Adopt the paths of a child instead of branching when they're as cheap and have fewer conflicts
+	bool rectangle_reasoning = false;  // Split rectangle conflicts with barrier constraints
+	bool corridor_reasoning = false;  // Split corridor conflicts with range constraints
+	bool target_reasoning = false;  // Split conflicts at the goals of agents that reached them with length constraints
+	int merge_threshold = -1;  // Merge two meta-agents after they conflicted more than this many times on a branch, and
+	                           // plan them together from then on (-1: never). Only in the serial best-first search
+	                           // with non-disjoint splits.
+	bool mutex_reasoning = false;  // Classify conflicts with mutex propagation on the MDDs of both agents, and split
+	                               // them on levels of the MDDs whose nodes are all mutex
+	bool runs_concurrently = false;  // Other searches run in the same process, so it's cut off by wall time
 
 	// Used to ease tracking of the order of nodes in iterative deepening runs
 	uint64_t HL_num_generated_before_this_iteration = 0;
@@ -39,6 +72,24 @@ public:
 	uint64_t LL_num_expanded = 0;
 	uint64_t LL_num_generated = 0;
 	uint64_t HL_num_reexpanded = 0;
+	uint64_t HL_num_bypassed = 0;  // nodes that adopted the paths of a child instead of branching
+	uint64_t wdg_num_subproblems = 0;  // 2-agent sub-problems solved for the WDG heuristic
+	uint64_t wdg_num_cache_hits = 0;
+	uint64_t mdd_cache_hits = 0;
+	uint64_t mdd_cache_misses = 0;
+	clock_t mdd_cache_saved_time = 0;  // CPU time it took to build the MDDs that were later found in the cache
+	uint64_t mdd_num_incremental_updates = 0;  // MDDs derived from a cached MDD by pruning a single constraint
+	uint64_t mdd_num_from_lpa = 0;  // MDD widths read off the agent's LPA* instance instead of building an MDD
+	uint64_t mdd_num_windowed = 0;  // MDDs built only around a conflict
+	uint64_t id_table_hits = 0;  // ID-CBSH nodes whose h-value was taken from the transposition table
+	uint64_t id_table_cutoffs = 0;  // ID-CBSH nodes the transposition table proved to exceed the threshold
+	uint64_t num_rectangle_splits = 0;  // nodes split on a rectangle conflict
+	uint64_t num_corridor_splits = 0;  // nodes split on a corridor conflict
+	uint64_t num_target_splits = 0;  // nodes split on a target conflict
+	uint64_t num_mutex_cardinal = 0;  // conflicts only mutex propagation found to be cardinal
+	uint64_t num_mutex_splits = 0;  // nodes split on a mutex conflict
+	uint64_t num_merges = 0;  // nodes whose conflict was resolved by merging its agents' meta-agents
+	uint64_t hybrid_switch_generated = 0;  // CT nodes the hybrid search's best-first phase generated before it switched to ID-CBSH
 	string max_mem;
 
 	// statistics of solution quality
@@ -54,15 +105,28 @@ public:
 	void printPaths(vector<vector<PathEntry> *> &the_paths) const;
 	void printResults() const;
 	void saveResults(const string& outputFile, const string& agentFile, const string& solver) const;
+	double getMddCacheHitRate() const;
+	string getIDIterations() const;
+	bool timedOut() const;
+	bool cancelled() const;
 
 	void isFeasible()  const;
+	// The path of the given agent in the solution, once one was found
+	inline const vector<PathEntry>& getPath(int ag) const { return *paths[ag]; }
 
 	bool runICBSSearch();
-	bool runIterativeDeepeningICBSSearch();
+	bool runIterativeDeepeningICBSSearch(int min_threshold = 0, std::clock_t start = std::clock(),
+	                                     std::chrono::system_clock::time_point wall_start =
+	                                         std::chrono::system_clock::now());
+	bool runHybridICBSSearch();
 	ICBSSearch(const MapLoader& ml, const AgentsLoader& al, double focal_w, split_strategy c, bool HL_h, int cutoffTime,
 	           int screen = 0);
+	ICBSSearch(ICBSSearch& prototype, split_strategy c);  // a member of a portfolio
 	~ICBSSearch();
 
+	// Stop this search and every search it shares its caches with - its workers and the other members of its portfolio
+	void cancel();
+
 
 private:
 	typedef boost::heap::fibonacci_heap< ICBSNode*, boost::heap::compare<ICBSNode::compare_node> > heap_open_t;
@@ -71,21 +135,78 @@ private:
 	heap_open_t open_list;
 	heap_focal_t focal_list;
 	list<ICBSNode*> allNodes_table;
+	// The LPA* instances the nodes in allNodes_table created for themselves. Expanded nodes drop their lpas, so these
+	// can't be found through the nodes when the CT is freed.
+	std::unordered_set<LPAStar*> lpa_copies;
+
+	// Parallel best-first search: the workers share their master's OPEN, FOCAL and node table, guarded by its
+	// frontier_mutex, and the master's counters of generated and expanded nodes
+	ICBSSearch* master = nullptr;  // the search this one is a worker of
+	bool in_portfolio = false;  // other searches run in the same process, each on its own thread
+	std::mutex frontier_mutex;
+	std::condition_variable frontier_changed;
+	std::multiset<int> expanding_f_vals;  // the f-values of the nodes the workers are expanding
+	ICBSNode* incumbent = nullptr;  // the cheapest conflict-free node found, until it's proven good enough
+	bool search_done = false;
+
+	// Parallel ID-CBSH: the master explores the top of the CT of each iteration itself and hands the subtrees below
+	// id_task_depth to its workers, each with its own copy of the node, LPA* instances, paths and CAT
+	std::unique_ptr<TaskPool> id_pool;  // runs the subtrees, while an iteration is in progress
+	vector<std::unique_ptr<ICBSSearch>> id_workers;  // one for each thread of the pool
+	int id_task_depth = 0;
+	std::atomic<int> id_next_threshold{0};  // the lowest f-value over the threshold that the workers found
+	std::atomic<bool> id_stop{false};  // set when a solution was found, to cancel the rest of the iteration
+	std::chrono::system_clock::time_point wall_end_by;
+	vector<vector<PathEntry>> solution_paths;  // of a worker that found a solution
+
+	// The ID-CBSH transposition table, in the spirit of memory-enhanced IDA*: what earlier visits found about the
+	// node with a given set of constraints, so later iterations don't recompute its heuristic, and skip its subtree
+	// if it's known to exceed their threshold. Only a single-threaded ID-CBSH uses it.
+	struct IDTableEntry {
+		size_t check;  // the second hash of the constraints, so only the branch the entry was stored for can use it
+		int h_val;
+		ConflictId conflict;  // the conflict the node was split on
+		int bound;  // a lower bound on the cost of the solutions under the node, found by the last iteration that visited it
+	};
+	std::unordered_map<size_t, IDTableEntry> id_table;  // hash of the constraints on the branch -> entry
+	void storeInIDTable(size_t key, size_t check, int h_val, ConflictId conflict, int bound);
+
+	// ID-CBSH threshold growth: when an iteration's threshold is above the lowest f-value the last one cut off, the
+	// first solution it finds may not be optimal. It's kept as the incumbent, and the rest of the iteration only looks
+	// for cheaper ones.
+	std::map<int, uint64_t> id_cut_off_f_vals;  // f-value -> number of nodes the current iteration cut off with it
+	int id_lower_bound = std::numeric_limits<int>::max();  // no solution costs less
+	int id_upper_bound = std::numeric_limits<int>::max();  // the cost of the incumbent
+	double id_node_budget = 0;  // of the next iteration, for BUDGET
+	vector<pair<int, uint64_t>> id_iterations;  // (threshold, nodes expanded) of each iteration
+	void idcbshCutOff(int f_val, int& next_threshold);
+
+	// hybrid search
+	bool hybrid = false;  // whether the best-first search should stop when its budget is used up
+	bool bf_budget_exhausted = false;
+	uint64_t next_memory_check = 0;  // the number of generated nodes to read the resident memory at
+	bool bfBudgetExhausted();
+	void dropCTForIDCBSH(const vector<LPAStar*>& root_lpas);
+	int nextIDCBSHThreshold(int lowest_cut_off_f_val, uint64_t expanded);
 
 	// input
 	int map_size;
 	int num_of_agents;
 	const int* moves_offset;
 	int num_map_cols;
+	vector<MapLoader::Corridor> corridors;
+	vector<int> corridor_of;  // the index of the corridor each cell is in, or -1
 
 	std::vector < std::unordered_map<int, AvoidanceState > > root_cat;
 	ICBSNode* root_node;
 	vector < ICBSSingleAgentLLSearch* > search_engines;  // used to find (single) agents' paths and mdd
 	vector<vector<PathEntry>*> paths;  // The paths of the node we're currently working on.
 	                                   // This trades the speed of rebuilding it each time we move to a new node for
-	                                   // the space of saving it on every node.
+	                                   // the space of saving it on every node. Best-first search switches it to the
+	                                   // next node by only changing the paths that differ between the two.
 	                                   // For best-first-search CBS, this is also the set of paths of the best node in OPEN.
 	vector<vector<PathEntry>> paths_found_initially;  // contains the initial path that was found for each agent
+	OccupancyIndex occupancy_index;  // where the paths in the paths vector (or the ID-CBSH paths) are in space-time
 
 	// print
 	void printConflicts(const ICBSNode &n) const;
@@ -93,27 +214,57 @@ private:
 
 	//conflicts
 	void findConflicts(ICBSNode& curr);
-	void findConflicts(vector<vector<PathEntry> *> &the_paths, int a1, int a2, ICBSNode &curr);
-	std::shared_ptr<Conflict> classifyConflicts(ICBSNode &node, vector<vector<PathEntry> *> &the_paths);
-	std::shared_ptr<Conflict> getHighestPriorityConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths);
-	std::shared_ptr<Conflict> getHighestPriorityConflict(const list<std::shared_ptr<Conflict>> &confs,
-                                                         vector<vector<PathEntry> *> &the_paths,
-                                                         const vector<double> &widthMDD,
-                                                         const vector<int> &metric);
+	void findConflictsOfAgent(ICBSNode &curr, vector<vector<PathEntry> *> &the_paths, int ag);
+	ConflictId classifyConflicts(ICBSNode &node, vector<vector<PathEntry> *> &the_paths);
+	ConflictId getHighestPriorityConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths);
+	ConflictId getHighestPriorityConflict(const vector<ConflictId> &confs,
+                                          vector<vector<PathEntry> *> &the_paths,
+                                          const vector<double> &widthMDD,
+                                          const vector<int> &metric);
 	void copyConflictsFromParent(ICBSNode& curr);
 	void clearConflictsOfAgent(ICBSNode &curr, int ag);
 	void copyConflicts(const vector<bool>& unchanged,
-		const list<std::shared_ptr<Conflict>>& from, list<std::shared_ptr<Conflict>>& to);
+		const vector<ConflictId>& from, vector<ConflictId>& to);
 	void clearConflictsOfAffectedAgents(bool *unchanged,
-                                        list<std::shared_ptr<Conflict>> &lst);
+                                        vector<ConflictId> &lst);
+	ConflictId findRectangleConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2,
+	                                 int timestep, bool &cardinal1, bool &cardinal2);
+	void getRectangleBarrier(const Conflict &conflict, int ag, vector<Constraint> &barrier) const;
+	ConflictId findCorridorConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2,
+	                                int loc1, int loc2, int timestep, bool &cardinal1, bool &cardinal2);
+	Constraint getCorridorConstraint(const Conflict &conflict, int ag);
+	// Distances from the starts of the agents, for corridor reasoning, computed when they're first needed
+	vector<vector<int>> start_distances;  // of each agent to every cell
+	std::unordered_map<int64_t, pair<int, int>> bypass_distances;  // (agent, corridor) -> to its entrances, around it
+	int distanceFromStart(int ag, int loc);
+	int bypassDistanceFromStart(int ag, int corridor, int entrance);
+	void distancesFrom(int loc, int blocked_corridor, vector<int> &distances) const;
+	ConflictId findTargetConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2, int loc,
+	                              int timestep);
+	Constraint getTargetConstraint(const Conflict &conflict, int ag) const;
+	// (the cells, sorted, followed by the goal) -> whether the goal stays connected to its part of the map without them
+	std::map<vector<int>, bool> goal_connectivity;
+	bool goalStaysConnected(int goal, vector<int> blocked);
+	ConflictId findMutexConflict(ICBSNode &node, vector<vector<PathEntry> *> &the_paths, int a1, int a2,
+	                             int timestep, bool &cardinal);
 
 	// branch
 	void branch(ICBSNode* curr, ICBSNode* n1, ICBSNode*n2);
+	void branchDisjoint3(ICBSNode* curr, ICBSNode* n1, ICBSNode* n2, ICBSNode* n3);
+	void constrainAgentOfConflict(ICBSNode* curr, ICBSNode* child, int ag, bool positive);
+	void generateDisjoint3Children(ICBSNode* curr);
 	bool findPathForSingleAgent(ICBSNode *node, vector<vector<PathEntry> *> &the_paths,
 	                            vector<unordered_map<int, AvoidanceState >> *the_cat,
 	                            int timestep, int earliestGoalTimestep, int ag, bool skipNewpaths = false);
 	bool generateChild(ICBSNode *node, vector<vector<PathEntry> *> &the_paths);
+	bool bypassConflict(ICBSNode *curr, ICBSNode *n1, ICBSNode *n2);
+	bool planChild(ICBSNode *node, vector<vector<PathEntry> *> &the_paths);
 	bool finishPartialExpansion(ICBSNode *node, vector<vector<PathEntry> *> &the_paths);
+	// merging
+	bool shouldMerge(const ICBSNode *curr) const;
+	bool planMergedChild(ICBSNode *curr, ICBSNode *node, vector<vector<PathEntry> *> &the_paths);
+	bool findPathsForMetaAgent(ICBSNode *node, vector<vector<PathEntry> *> &the_paths, int meta_agent);
+	vector<PathEntry>* newPathOf(ICBSNode *node, int ag);
 	void buildConflictAvoidanceTable(vector<vector<PathEntry> *> &the_paths, int exclude_agent, const ICBSNode &node,
                                      std::vector<std::unordered_map<int, AvoidanceState> > &cat);
 	int  buildConstraintTable(ICBSNode* curr, int agent_id, int timestep, 
@@ -129,29 +280,107 @@ private:
 
 	// update
 	inline void populatePaths(ICBSNode *curr, vector<vector<PathEntry> *> &the_paths);
+	ICBSNode* paths_node = nullptr;  // the node whose paths are in the paths vector, nullptr before the first switch
+	// For each agent, the paths the nodes on the way from the root to paths_node gave it, the deepest last
+	vector<vector<pair<const ICBSNode*, vector<PathEntry>*>>> path_versions;
+	vector<int> replanned_agents;  // agents findPathForSingleAgent replanned in the paths vector since restorePaths
+	void switchPaths(ICBSNode* target);
+	void undoPathsOf(const ICBSNode* node);
+	void applyPathsOf(ICBSNode* node);
+	void restorePaths();
+	inline vector<PathEntry>* pathOfPathsNode(int ag) {
+		return path_versions[ag].empty() ? &paths_found_initially[ag] : path_versions[ag].back().second;
+	}
+	void pushNode(ICBSNode* node);
+	int lowestFVal() const;
+	void updateLowerBound();
+	void acceptIncumbentIfProven();
+
+	// parallel best-first search
+	explicit ICBSSearch(ICBSSearch& master);  // a worker of the given search
+	bool runParallelICBSSearch(std::clock_t start, std::chrono::system_clock::time_point wall_start);
+	void expandNodes(std::chrono::system_clock::time_point wall_start);
+	void addStatistics(const ICBSSearch& worker);
 	void collectConstraints(ICBSNode* curr, std::list<pair<int, tuple<int, int, int, bool>>> &constraints);
 	bool reinsert(ICBSNode* curr);
 	void updateFocalList(double old_lower_bound, double new_lower_bound, double f_weight);
 
 
 	// high-level heuristics
-	int computeHeuristics(const ICBSNode& curr);
+	int computeHeuristics(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths);
 	bool KVertexCover(const vector<vector<bool>>& CG, int num_of_CGnodes, int num_of_CGedges, int k);
+	int computeWDGHeuristics(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths);
+	int getPairCostIncrease(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths, int a1, int a2);
+	int solve2Agents(ICBSNode& curr, vector<vector<PathEntry> *> &the_paths, int a1, int a2);
+	pair<size_t, size_t> hashConstraintsOfAgent(const ICBSNode* curr, int agent_id) const;
+	pair<size_t, size_t> hashConstraints(const ICBSNode* curr) const;
+	int minimumWeightedVertexCover(const vector<vector<int>>& WDG);
+	int weightedVertexCover(const vector<vector<int>>& WDG, const vector<int>& nodes, vector<int>& x,
+	                        int i, int sum, int best_so_far);
+
+	// (agent1, agent2, hashes of agent1's constraints, hashes of agent2's constraints) -> optimal cost of the pair
+	// The second hash of each pair is only compared, so a collision of the first doesn't return another branch's cost.
+	struct WDGCacheKey {
+		int a1;
+		int a2;
+		pair<size_t, size_t> h1;
+		pair<size_t, size_t> h2;
+		bool operator==(const WDGCacheKey& other) const {
+			return a1 == other.a1 && a2 == other.a2 && h1 == other.h1 && h2 == other.h2;
+		}
+	};
+	struct WDGCacheKeyHasher {
+		std::size_t operator()(const WDGCacheKey& k) const {
+			size_t seed = std::hash<int>()(k.a1);
+			seed ^= std::hash<int>()(k.a2) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= k.h1.first + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= k.h2.first + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			return seed;
+		}
+	};
+
+	// What a search shares with its workers
+	struct SharedState {
+		ConflictPool conflict_pool;
+		MDDCache mdd_cache;
+		std::unordered_map<WDGCacheKey, int, WDGCacheKeyHasher> wdg_cache;
+		std::mutex wdg_cache_mutex;
+		std::atomic<bool> cancelled{false};
+	};
+	std::shared_ptr<SharedState> shared;
+	ConflictPool& conflict_pool;  // the records of the conflicts the nodes refer to by ID
+	MDDCache& mdd_cache;  // MDDs that were already built
+	std::unordered_map<WDGCacheKey, int, WDGCacheKeyHasher>& wdg_cache;  // guarded by shared->wdg_cache_mutex
 	
 	// tools
     void buildMDD(ICBSNode &curr, vector<vector<PathEntry> *> &the_paths, int ag, int timestep, int lookahead = 0);
+	ICBSNode* lastNodeThatReplanned(ICBSNode &curr, int ag) const;
+	std::shared_ptr<const MDD> getMDD(ICBSNode *node, vector<vector<PathEntry> *> &the_paths, int ag, int timestep,
+	                                  int lookahead, pair<int, int>& start, pair<int, int>& goal);
+	void narrowToLandmarks(const ICBSNode* curr, int agent_id, int timestep, pair<int, int>& start,
+	                       pair<int, int>& goal) const;
+	bool hasPositiveConstraints(const ICBSNode* curr, int agent_id) const;
 	bool arePathsConsistentWithConstraints(vector<vector<PathEntry> *> &the_paths, ICBSNode *curr) const;
 	inline int getAgentLocation(vector<vector<PathEntry> *> &the_paths, size_t timestep, int agent_id);
 
 	std::tuple<bool, int> do_idcbsh_iteration(ICBSNode *curr, vector<vector<PathEntry> *> &the_paths,
 	                                          vector<unordered_map<int, AvoidanceState >> &the_cat,
-	                                          int threshold, int next_threshold, clock_t end_by);
+	                                          int threshold, int next_threshold, clock_t end_by, int depth = 0);
+	std::tuple<bool, int> do_idcbsh_disjoint3_split(ICBSNode *curr, vector<vector<PathEntry> *> &the_paths,
+	                                                vector<unordered_map<int, AvoidanceState >> &the_cat,
+	                                                int threshold, int next_threshold, clock_t end_by, int depth);
+	bool idcbshStopped(clock_t end_by) const;
+	std::tuple<bool, int> do_parallel_idcbsh_iteration(vector<vector<PathEntry> *> &the_paths, int threshold);
+	void spawnIDCBSHTask(const ICBSNode *curr, const vector<vector<PathEntry> *> &the_paths,
+	                     const vector<unordered_map<int, AvoidanceState >> &the_cat, int threshold, int depth);
+	void runIDCBSHTask(ICBSNode &node, vector<vector<PathEntry> *> &the_paths,
+	                   vector<unordered_map<int, AvoidanceState >> &the_cat, int threshold, int depth);
 	tuple<bool, bool> idcbsh_add_constraint_and_replan(ICBSNode *node, vector<vector<PathEntry> *> &the_paths,
 	                                                   vector<unordered_map<int, AvoidanceState >> &the_cat, int max_cost);
 	void idcbsh_unconstrain(ICBSNode *node, vector<vector<PathEntry> *> &the_paths,
 	                        vector<unordered_map<int, AvoidanceState >> &the_cat,
 	                        vector<PathEntry> &path_backup,
-	                        shared_ptr<Conflict> &conflict_backup, int makespan_backup, int g_val_backup,
+	                        ConflictId conflict_backup, int makespan_backup, int g_val_backup,
 	                        int h_val_backup);
 };
 
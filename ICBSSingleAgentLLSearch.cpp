@@ -75,13 +75,19 @@ int ICBSSingleAgentLLSearch::extractLastGoalTimestep(int goal_location, const ve
 // Checks if a move into next_id at next_timestepfrom direction is valid (wrt my_map and constraints)
 // input: direction (into next_id) ; next_id (location at time next_timestep); next_timestep
 // cons[timestep] is a list of <loc1,loc2, bool> of (vertex/edge) constraints for that timestep. (loc2=-1 for vertex constraint).
+// After the last timestep of cons_table, only the vertices it constrains forever are constrained.
 bool ICBSSingleAgentLLSearch::isConstrained(int direction, int next_id, int next_timestep,
 	const std::vector < std::unordered_map<int, ConstraintState > >& cons_table)  const 
 {
 	if (my_map[next_id]) // obstacles
 		return true;
 	else if (next_timestep >= cons_table.size())
-		return false;
+	{
+		if (cons_table.empty())
+			return false;
+		auto it = cons_table.back().find(next_id);
+		return it != cons_table.back().end() && it->second.forever;
+	}
 	auto it = cons_table[next_timestep].find(next_id);
 	if (it == cons_table[next_timestep].end())
 		return false;
@@ -217,6 +223,8 @@ bool ICBSSingleAgentLLSearch::findShortestPath(vector<PathEntry> &path,
 		open_list.erase(curr->open_handle);
 		curr->in_openlist = false;	
 
+		if (curr->timestep > goal.second) // did not reach the goal location before the required timestep
+			continue;
 		// check if the popped node is a goal
 		if (curr->loc == goal.first && curr->timestep > lastGoalConsTime)
 		{
@@ -227,8 +235,6 @@ bool ICBSSingleAgentLLSearch::findShortestPath(vector<PathEntry> &path,
 			allNodes_table.clear();
 			return true;
 		}
-		else if (curr->timestep > goal.second) // did not reach the goal location before the required timestep
-			continue;
 		num_expanded++;
 		for (int i = 0; i < 5; i++)
 		{
@@ -4,201 +4,333 @@ bool MDD::buildMDD(const std::vector < std::unordered_map<int, ConstraintState >
 	const pair<int, int> &start, const pair<int, int>&goal, int lookahead, const ICBSSingleAgentLLSearch & solver)
 {
 	int numOfLevels = goal.second - start.second + lookahead + 1;
-	int current_cost = goal.second - start.second;
-	MDDNode* root = new MDDNode(start.first, nullptr); // Root
-	queue<MDDNode*> open;
-	list<MDDNode*> closed;
-	open.push(root);
-	closed.push_back(root);
-	levels.resize(numOfLevels);
-	while (!open.empty()) //BFS from root node
+
+	// Forward: generate the nodes of each level from the nodes of the previous one, level by level.
+	// level_locations[t] - the locations reached at level t, in the order they were reached
+	// level_edges[t] - (index of the parent in level t - 1, index of the child in level t)
+	vector<vector<int>> level_locations(numOfLevels);
+	vector<vector<pair<int, int>>> level_edges(numOfLevels);
+	vector<int> index_in_level(solver.map_size, -1);  // Where each location was reached in the level being generated
+	level_locations[0].push_back(start.first);
+	for (int t = 0; t < numOfLevels - 1; t++)
+	{
+		int heuristicBound = numOfLevels - t - 2; // We want (g + 1)+h <= f = numOfLevels - 1, so h <= numOfLevels - g. -1 because it's the bound of the _children_.
+		int next_timestep = t + 1 + start.second;
+		for (int i = 0; i < (int)level_locations[t].size(); i++)
+		{
+			int loc = level_locations[t][i];
+			for (int m = 0; m < 5; m++) // Try every possible move
+			{
+				int newLoc = loc + solver.moves_offset[m];
+				if (newLoc < 0 || newLoc >= solver.map_size || abs(newLoc % solver.num_col - loc % solver.num_col) >= 2)
+					continue;
+				if (t + 1 == numOfLevels - 1 && newLoc != goal.first)
+					continue;
+				if (solver.getDifferentialHeuristic(newLoc, goal.first) > heuristicBound)
+					continue;
+				else if (solver.isConstrained(m, newLoc, next_timestep, cons_table))
+					continue;
+				if (index_in_level[newLoc] < 0) // Else generate a new mdd node
+				{
+					index_in_level[newLoc] = (int)level_locations[t + 1].size();
+					level_locations[t + 1].push_back(newLoc);
+				}
+				level_edges[t + 1].emplace_back(i, index_in_level[newLoc]);
+			}
+		}
+		for (int loc : level_locations[t + 1])
+			index_in_level[loc] = -1;
+	}
+
+	// Backward: keep only the nodes that lead to the goal
+	vector<vector<bool>> useful(numOfLevels);
+	for (int t = 0; t < numOfLevels; t++)
+		useful[t].resize(level_locations[t].size(), false);
+	for (int i = 0; i < (int)level_locations[numOfLevels - 1].size(); i++)
+		useful[numOfLevels - 1][i] = level_locations[numOfLevels - 1][i] == goal.first;
+	for (int t = numOfLevels - 1; t > 0; t--)
+		for (const auto& [parent, child] : level_edges[t])
+			if (useful[t][child])
+				useful[t - 1][parent] = true;
+
+	// Number the useful nodes level by level, sorted by location
+	vector<vector<int>> node_of(numOfLevels);  // node_of[t][i] - the node of the i'th location reached at level t
+	level_start.assign(numOfLevels + 1, 0);
+	widths.assign(numOfLevels, 0);
+	locations.clear();
+	for (int t = 0; t < numOfLevels; t++)
 	{
-		MDDNode* node = open.front();
-		open.pop();
+		level_start[t] = (int)locations.size();
+		vector<int> order;
+		for (int i = 0; i < (int)level_locations[t].size(); i++)
+			if (useful[t][i])
+				order.push_back(i);
+		std::sort(order.begin(), order.end(),
+		          [&](int a, int b) { return level_locations[t][a] < level_locations[t][b]; });
+		node_of[t].assign(level_locations[t].size(), -1);
+		for (int i : order)
+		{
+			node_of[t][i] = (int)locations.size();
+			locations.push_back(level_locations[t][i]);
+		}
+		widths[t] = (int)order.size();
+	}
+	level_start[numOfLevels] = (int)locations.size();
 
-		if (node->level == numOfLevels - 1)
+	// Build the edge arrays
+	int num_nodes = (int)locations.size();
+	num_children.assign(num_nodes, 0);
+	num_parents.assign(num_nodes, 0);
+	removed.assign(num_nodes, false);
+	for (int t = 1; t < numOfLevels; t++)
+	{
+		for (const auto& [parent, child] : level_edges[t])
 		{
-			if (node->location != goal.first)
+			if (!useful[t][child])
 				continue;
-			levels[numOfLevels - 1].push_back(node);
-			break;
+			num_children[node_of[t - 1][parent]]++;
+			num_parents[node_of[t][child]]++;
 		}
-		int heuristicBound = numOfLevels - node->level - 2; // We want (g + 1)+h <= f = numOfLevels - 1, so h <= numOfLevels - g. -1 because it's the bound of the _children_.
-		if (heuristicBound < 0)
+	}
+	child_start.assign(num_nodes + 1, 0);
+	parent_start.assign(num_nodes + 1, 0);
+	for (int n = 0; n < num_nodes; n++)
+	{
+		child_start[n + 1] = child_start[n] + num_children[n];
+		parent_start[n + 1] = parent_start[n] + num_parents[n];
+	}
+	children.assign(child_start[num_nodes], -1);
+	parents.assign(parent_start[num_nodes], -1);
+	vector<int> next_child(child_start.begin(), child_start.end() - 1);
+	vector<int> next_parent(parent_start.begin(), parent_start.end() - 1);
+	for (int t = 1; t < numOfLevels; t++)
+	{
+		for (const auto& [parent, child] : level_edges[t])
 		{
-			std::cout << "heuristic bound is negative!" << std::endl; // Will it happen?
-			heuristicBound = 0;
+			if (!useful[t][child])
+				continue;
+			int from = node_of[t - 1][parent];
+			int to = node_of[t][child];
+			children[next_child[from]++] = to;
+			parents[next_parent[to]++] = from;
 		}
+	}
+	return true;
+}
+
+void MDD::buildWindowWidths(const std::vector < std::unordered_map<int, ConstraintState > >& cons_table,
+	const pair<int, int> &start, const pair<int, int>&goal, int first_timestep, int last_timestep,
+	const ICBSSingleAgentLLSearch & solver, vector<int>& widths)
+{
+	int numOfLevels = last_timestep - first_timestep + 1;
+	vector<vector<int>> level_locations(numOfLevels);
+	vector<vector<pair<int, int>>> level_edges(numOfLevels);
+	vector<int> index_in_level(solver.map_size, -1);
 
-		for (int i = 0; i < 5; i++) // Try every possible move. We only add backward edges in this step.
+	// The first level: every location within reach of the start that can still reach the goal in time.
+	// The cells within Manhattan distance <radius> of the start are the only candidates.
+	if (first_timestep == start.second)
+		level_locations[0].push_back(start.first);
+	else
+	{
+		int radius = first_timestep - start.second;
+		int num_rows = solver.map_size / solver.num_col;
+		int start_row = start.first / solver.num_col;
+		int start_col = start.first % solver.num_col;
+		for (int row = std::max(0, start_row - radius); row <= std::min(num_rows - 1, start_row + radius); row++)
 		{
-			int newLoc = node->location + solver.moves_offset[i];
-			int next_timestep = node->level + 1 + start.second;
-			if (0 <= newLoc && newLoc < solver.map_size && abs(newLoc % solver.num_col - node->location % solver.num_col) < 2)
+			int col_radius = radius - abs(row - start_row);
+			for (int col = std::max(0, start_col - col_radius); col <= std::min(solver.num_col - 1, start_col + col_radius); col++)
 			{
-				if (solver.getDifferentialHeuristic(newLoc, goal.first) > heuristicBound)
+				int loc = row * solver.num_col + col;
+				if (solver.my_map[loc] ||
+					solver.getDifferentialHeuristic(start.first, loc) > radius ||
+					solver.getDifferentialHeuristic(loc, goal.first) > goal.second - first_timestep)
 					continue;
-				else if (solver.isConstrained(i, newLoc, next_timestep, cons_table))
-					continue;
-
-				list<MDDNode*>::reverse_iterator child = closed.rbegin();
-				bool find = false;
-				for (; child != closed.rend() && ((*child)->level == node->level + 1); ++child)
-					if ((*child)->location == newLoc) // If the child node exists
-					{
-						(*child)->parents.push_back(node); // then add corresponding parent link and child link
-						find = true;
-						break;
-					}
-				if (!find) // Else generate a new mdd node
+				if (first_timestep < (int)cons_table.size())
 				{
-					MDDNode* childNode = new MDDNode(newLoc, node);
-					open.push(childNode);
-					closed.push_back(childNode);
+					auto it = cons_table[first_timestep].find(loc);
+					if (it != cons_table[first_timestep].end() && it->second.vertex)
+						continue;
 				}
+				if (first_timestep == goal.second && loc != goal.first)
+					continue;
+				level_locations[0].push_back(loc);
 			}
 		}
 	}
-	// Backward
-	for (int t = numOfLevels - 1; t > 0; t--)
+
+	// Forward, like in buildMDD
+	for (int t = 0; t < numOfLevels - 1; t++)
 	{
-		for (list<MDDNode*>::iterator it = levels[t].begin(); it != levels[t].end(); ++it)
+		int next_timestep = first_timestep + t + 1;
+		int heuristicBound = goal.second - next_timestep;
+		for (int i = 0; i < (int)level_locations[t].size(); i++)
 		{
-			for (list<MDDNode*>::iterator parent = (*it)->parents.begin(); parent != (*it)->parents.end(); parent++)
+			int loc = level_locations[t][i];
+			for (int m = 0; m < 5; m++) // Try every possible move
 			{
-				if ((*parent)->children.empty()) // a new node
+				int newLoc = loc + solver.moves_offset[m];
+				if (newLoc < 0 || newLoc >= solver.map_size || abs(newLoc % solver.num_col - loc % solver.num_col) >= 2)
+					continue;
+				if (next_timestep == goal.second && newLoc != goal.first)
+					continue;
+				if (solver.getDifferentialHeuristic(newLoc, goal.first) > heuristicBound)
+					continue;
+				else if (solver.isConstrained(m, newLoc, next_timestep, cons_table))
+					continue;
+				if (index_in_level[newLoc] < 0)
 				{
-					levels[t - 1].push_back(*parent);
+					index_in_level[newLoc] = (int)level_locations[t + 1].size();
+					level_locations[t + 1].push_back(newLoc);
 				}
-				(*parent)->children.push_back(*it); // add forward edge	
+				level_edges[t + 1].emplace_back(i, index_in_level[newLoc]);
 			}
 		}
+		for (int loc : level_locations[t + 1])
+			index_in_level[loc] = -1;
 	}
 
-	// Delete useless nodes (nodes who don't have any children)
-	for (list<MDDNode*>::iterator it = closed.begin(); it != closed.end(); ++it)
-		if ((*it)->children.empty() && (*it)->level < numOfLevels - 1)
-			delete *it;
-	closed.clear();
-	return true;
+	// Backward: keep only the nodes that lead to the last level. Every node there that the heuristic didn't rule out
+	// might lead to the goal.
+	vector<vector<bool>> useful(numOfLevels);
+	for (int t = 0; t < numOfLevels; t++)
+		useful[t].resize(level_locations[t].size(), false);
+	useful[numOfLevels - 1].assign(level_locations[numOfLevels - 1].size(), true);
+	for (int t = numOfLevels - 1; t > 0; t--)
+		for (const auto& [parent, child] : level_edges[t])
+			if (useful[t][child])
+				useful[t - 1][parent] = true;
+
+	widths.assign(numOfLevels, 0);
+	for (int t = 0; t < numOfLevels; t++)
+		widths[t] = (int)std::count(useful[t].begin(), useful[t].end(), true);
 }
 
-bool MDD::updateMDD(const tuple<int, int, int> &constraint, int num_col)
+bool MDD::updateMDD(const Constraint &constraint, int start_timestep)
 {
-	auto [loc1, loc2, t] = constraint;
+	return updateMDD(vector<Constraint>{constraint}, start_timestep);
+}
 
-	if (loc2 < 0) // Edge constraint
-	{
-		for (list<MDDNode*>::iterator it = levels[t].begin(); it != levels[t].end(); ++it)
-			if ((*it)->location == loc1)
-				for (list<MDDNode*>::iterator child = (*it)->children.begin(); child != (*it)->children.end(); ++child)
-					if ((*child)->location == -loc2 - 1)
-					{
-						(*it)->children.erase(child);
-						(*child)->parents.remove(*it);
-						if ((*it)->children.empty())
-							deleteNode(*it);
-						if ((*child)->parents.empty())
-							deleteNode(*child);
-						return true;
-					}
-	}
-	else // Vertex constraint
+bool MDD::updateMDD(const vector<Constraint> &constraints, int start_timestep)
+{
+	// Nodes that were pruned or whose last parent or last child was pruned
+	vector<int> to_delete;
+	for (const Constraint& constraint : constraints)
 	{
-		list<MDDNode*> ToDelete;
-		for (list<MDDNode*>::iterator it = levels[t].begin(); it != levels[t].end(); ++it)
-			if (loc1 / num_col <= (*it)->location / num_col  && (*it)->location / num_col <= loc2 / num_col
-				&& loc1 % num_col <= (*it)->location % num_col  && (*it)->location % num_col <= loc2 % num_col)
-				ToDelete.push_back(*it);
-		for (list<MDDNode*>::iterator it = ToDelete.begin(); it !=ToDelete.end(); ++it)
-			deleteNode(*it);
-		return true;
+		auto [loc1, loc2, timestep, positive_constraint] = constraint;
+		if (isLengthConstraint(constraint))  // The MDD is of a cost the constraint allows, or there wouldn't be one
+			continue;
+		int level = timestep - start_timestep;
+		int last_level = isRangeConstraint(constraint) ? rangeEnd(constraint) - start_timestep : level;
+		if (last_level < 0 || level >= numLevels())
+			continue;
+
+		if (loc2 < 0) // vertex or range constraint
+		{
+			for (int l = max(level, 0); l <= min(last_level, numLevels() - 1); l++)
+			{
+				int node = find(loc1, l);
+				if (node >= 0)
+					to_delete.push_back(node);
+			}
+		}
+		else if (level > 0) // edge constraint
+		{
+			int from = find(loc1, level - 1);
+			int to = find(loc2, level);
+			if (from >= 0 && to >= 0 && removeEdge(from, to))
+			{
+				if (num_children[from] == 0)
+					to_delete.push_back(from);
+				if (num_parents[to] == 0)
+					to_delete.push_back(to);
+			}
+		}
 	}
-	return false;
-}
 
-void MDD::printMDD() const
-{
-	for (int i = 0; i < levels.size(); i++)
+	// Delete the nodes and whatever they leave dangling, following their edges
+	while (!to_delete.empty())
 	{
-		std::cout << "Time " << i << " : ";
-		for (auto node : levels[i])
+		int node = to_delete.back();
+		to_delete.pop_back();
+		if (removed[node])
+			continue;
+		removed[node] = true;
+		widths[levelOf(node)]--;
+		for (int i = child_start[node]; i < child_start[node + 1]; i++)
 		{
-			std::cout << node->location << ", ";
+			int child = children[i];
+			if (child < 0)
+				continue;
+			removeEdge(node, child);
+			if (num_parents[child] == 0)
+				to_delete.push_back(child);
+		}
+		for (int i = parent_start[node]; i < parent_start[node + 1]; i++)
+		{
+			int parent = parents[i];
+			if (parent < 0)
+				continue;
+			removeEdge(parent, node);
+			if (num_children[parent] == 0)
+				to_delete.push_back(parent);
 		}
-		std:: cout << std::endl;
 	}
-}
 
+	return !widths.empty() && widths[0] > 0;
+}
 
-void MDD::deleteNode(MDDNode* node)
+int MDD::find(int location, int level) const
 {
-	levels[node->level].remove(node);
-	for (list<MDDNode*>::iterator child = node->children.begin(); child != node->children.end(); ++child)
-	{
-		(*child)->parents.remove(node);
-		if ((*child)->parents.empty())
-			deleteNode(*child);
-	}
-	for (list<MDDNode*>::iterator parent = node->parents.begin(); parent != node->parents.end(); ++parent)
-	{
-		(*parent)->children.remove(node);
-		if ((*parent)->children.empty())
-			deleteNode(*parent);
-	}
+	if (level < 0 || level >= numLevels())
+		return -1;
+	auto first = locations.begin() + level_start[level];
+	auto last = locations.begin() + level_start[level + 1];
+	auto it = std::lower_bound(first, last, location);
+	if (it == last || *it != location)
+		return -1;
+	int node = (int)(it - locations.begin());
+	return removed[node] ? -1 : node;
 }
 
-void MDD::clear()
+int MDD::levelOf(int node) const
 {
-	if (levels.empty())
-		return;
-	for (int i = 0; i < levels.size(); i++)
-	{
-		for (list<MDDNode*>::iterator it = levels[i].begin(); it != levels[i].end(); ++it)
-			delete *it;
-	}
+	return (int)(std::upper_bound(level_start.begin(), level_start.end(), node) - level_start.begin()) - 1;
 }
 
-MDDNode* MDD::find(int location, int level) 
+bool MDD::removeEdge(int from, int to)
 {
-	if (level < levels.size())
-		for (list<MDDNode*>::iterator it = levels[level].begin(); it != levels[level].end(); ++it)
-			if ((*it)->location == location)
-				return (*it);
-	return nullptr;
+	int* last_child = children.data() + child_start[from + 1];
+	int* child = std::find(children.data() + child_start[from], last_child, to);
+	if (child == last_child)
+		return false;
+	*child = -1;
+	num_children[from]--;
+	*std::find(parents.data() + parent_start[to], parents.data() + parent_start[to + 1], from) = -1;
+	num_parents[to]--;
+	return true;
 }
 
-MDD::MDD(MDD & cpy) // deep copy
+void MDD::printMDD() const
 {
-	levels.resize(cpy.levels.size());
-	MDDNode* root = new MDDNode(cpy.levels[0].front()->location, NULL);
-	levels[0].push_back(root);
-	for(int t = 0; t < levels.size() - 1; t++)
+	for (int i = 0; i < numLevels(); i++)
 	{
-		for (list<MDDNode*>::iterator node = levels[t].begin(); node != levels[t].end(); ++node)
+		std::cout << "Time " << i << " : ";
+		for (int node = level_start[i]; node < level_start[i + 1]; node++)
 		{
-			MDDNode* cpyNode = cpy.find((*node)->location, (*node)->level);
-			for (list<MDDNode*>::const_iterator cpyChild = cpyNode->children.begin(); cpyChild != cpyNode->children.end(); ++cpyChild)
-			{
-				MDDNode* child = find((*cpyChild)->location, (*cpyChild)->level);
-				if (child == nullptr)
-				{
-					child = new MDDNode((*cpyChild)->location, (*node));
-					levels[child->level].push_back(child);
-					(*node)->children.push_back(child);
-				}
-				else
-				{
-					child->parents.push_back(*node);
-					(*node)->children.push_back(child);
-				}
-			}
+			if (!removed[node])
+				std::cout << locations[node] << ", ";
 		}
-		
+		std:: cout << std::endl;
 	}
 }
 
-MDD::~MDD()
+size_t MDD::memoryUsage() const
 {
-	clear();
+	return sizeof(MDD) +
+	       (level_start.capacity() + locations.capacity() + child_start.capacity() + children.capacity() +
+	        parent_start.capacity() + parents.capacity() + num_children.capacity() + num_parents.capacity() +
+	        widths.capacity()) * sizeof(int) +
+	       removed.capacity() / 8;
 }
@@ -1,53 +1,58 @@
 #pragma once
 #include "ICBSSingleAgentLLSearch.h"
 
-class MDDNode
-{
-public:
-	MDDNode(int currloc, MDDNode* parent)
-	{
-		location = currloc; 
-		if (parent == NULL)
-			level = 0;
-		else
-		{
-			level = parent->level + 1;
-			parents.push_back(parent);
-		}
-
-		parent = NULL;
-	}
-	int location;
-	int level;
-
-	bool operator == (const MDDNode & node) const
-	{
-		return (this->location == node.location) && (this->level == node.level);
-	}
-
-
-	list<MDDNode*> children;
-	list<MDDNode*> parents;
-	MDDNode* parent;
-};
-
+// A multi-valued decision diagram of all the paths of an agent of a given cost, stored level by level in flat arrays.
+// Nodes are numbered level after level, and the nodes of each level are sorted by location. The edges are kept in
+// CSR form in both directions.
+// Pruning (updateMDD) marks nodes and edges as removed instead of renumbering the nodes.
 class MDD
 {
 public:
-	vector<list<MDDNode*>> levels;
-
-	int numPointers; //used to count how many pointers pointed to this
 	bool buildMDD(const std::vector < std::unordered_map<int, ConstraintState > >& cons_table,
 		const pair<int, int> &start, const pair<int, int>&goal, int lookahead, const ICBSSingleAgentLLSearch & solver);
-	bool updateMDD(const tuple<int, int, int> &constraint, int num_col);
-	MDDNode* find(int location, int level);
-	void deleteNode(MDDNode* node);
-	void clear();
+	// Counts the nodes of the MDD at the timesteps first_timestep..last_timestep without building the rest of it.
+	// The nodes at first_timestep are all the locations the heuristics don't rule out, so the counts are upper bounds
+	// on the widths of the MDD's levels, and are exact when the window spans the whole MDD. A count of 1 is exact.
+	static void buildWindowWidths(const std::vector < std::unordered_map<int, ConstraintState > >& cons_table,
+		const pair<int, int> &start, const pair<int, int>&goal, int first_timestep, int last_timestep,
+		const ICBSSingleAgentLLSearch & solver, vector<int>& widths);
+	// Prune the nodes and edges the given negative constraint forbids, and every node that isn't on a path from the
+	// root to the goal anymore. The first level of the MDD is at start_timestep.
+	// Returns false if no path is left.
+	bool updateMDD(const Constraint &constraint, int start_timestep);
+	// Prune a set of negative constraints at once, like the vertex constraints of a rectangle's barrier, which may
+	// leave no path even though none of them does on its own
+	bool updateMDD(const vector<Constraint> &constraints, int start_timestep);
+	// Returns the node at the given location and level, or -1 if there isn't one
+	int find(int location, int level) const;
+	inline int numLevels() const { return (int)widths.size(); }
+	inline int width(int level) const { return widths[level]; }  // number of nodes in the level
+	// The nodes of a level are levelBegin(level) .. levelEnd(level) - 1, and the children of a node are
+	// child(i) for childBegin(node) <= i < childEnd(node). Pruned nodes stay in their levels, and pruned edges are -1.
+	inline int levelBegin(int level) const { return level_start[level]; }
+	inline int levelEnd(int level) const { return level_start[level + 1]; }
+	inline int location(int node) const { return locations[node]; }
+	inline bool isRemoved(int node) const { return removed[node]; }
+	inline int childBegin(int node) const { return child_start[node]; }
+	inline int childEnd(int node) const { return child_start[node + 1]; }
+	inline int child(int i) const { return children[i]; }
 	void printMDD() const;
-	
-
-	MDD(){};
-	MDD(MDD & cpy);
-	~MDD();
+	size_t memoryUsage() const;  // approximate number of bytes used by the MDD's arrays
+
+private:
+	vector<int> level_start;  // the nodes of level i are level_start[i] .. level_start[i + 1] - 1
+	vector<int> locations;  // the location of each node
+	vector<int> child_start;  // the children of node n are children[child_start[n] .. child_start[n + 1] - 1]
+	vector<int> children;  // -1 for a removed edge
+	vector<int> parent_start;  // the parents of node n are parents[parent_start[n] .. parent_start[n + 1] - 1]
+	vector<int> parents;  // -1 for a removed edge
+	vector<int> num_children;  // of each node, not counting removed edges
+	vector<int> num_parents;
+	vector<bool> removed;  // whether each node was pruned
+	vector<int> widths;  // the number of nodes in each level that weren't pruned
+
+	int levelOf(int node) const;
+	// Removes the edge between the nodes from both of their edge arrays. Returns false if there's no such edge.
+	bool removeEdge(int from, int to);
 };
 
@@ -7,6 +7,12 @@ std::ostream& operator<<(std::ostream& os, const Constraint& constraint)
     auto [loc1, loc2, timestep, positive_constraint] = constraint;
     if (loc2 == -1)
         os << "<(" << loc1 / GRID_ROWS << "," << loc1 % GRID_ROWS << "), " << timestep;
+    else if (isLengthConstraint(constraint))
+        os << "<length > " << timestep;
+    else if (isRangeConstraint(constraint) && rangeEnd(constraint) == FOREVER)
+        os << "<(" << loc1 / GRID_ROWS << "," << loc1 % GRID_ROWS << "), [" << timestep << ",inf]";
+    else if (isRangeConstraint(constraint))
+        os << "<(" << loc1 / GRID_ROWS << "," << loc1 % GRID_ROWS << "), [" << timestep << "," << rangeEnd(constraint) << "]";
     else
         os << "<(" << loc1 / GRID_ROWS << "," << loc1 % GRID_ROWS << "), (" << loc2 / GRID_ROWS << "," << loc2 % GRID_ROWS << "), " << timestep;
 	if (positive_constraint)
@@ -21,8 +27,38 @@ std::ostream& operator<<(std::ostream& os, const Conflict& conflict)
     auto [agent1, agent2, loc1, loc2, timestep] = conflict;
     if (loc2 == -1)
         os << "<" << agent1 << ", " << agent2 << ", (" << loc1 / GRID_ROWS << "," << loc1 % GRID_ROWS << "), " << timestep << ">";
+    else if (isMutexConflict(conflict))
+        os << "<" << agent1 << ", " << agent2 << ", mutex " << -2 - loc2 << ", " << timestep << ">";
+    else if (isTargetConflict(conflict))
+        os << "<" << agent1 << ", " << agent2 << ", target (" << loc2 / GRID_ROWS << "," << loc2 % GRID_ROWS << "), "
+                                                       << timestep << ">";
+    else if (isCorridorConflict(conflict))
+        os << "<" << agent1 << ", " << agent2 << ", corridor " << -2 - loc1 << " exited at ("
+                                                       << loc2 / GRID_ROWS << "," << loc2 % GRID_ROWS << "), " << timestep << ">";
+    else if (isRectangleConflict(conflict))
+        os << "<" << agent1 << ", " << agent2 << ", rectangle (" << loc1 / GRID_ROWS << "," << loc1 % GRID_ROWS << ")-("
+                                                       << (-2 - loc2) / GRID_ROWS << "," << (-2 - loc2) % GRID_ROWS << "), " << timestep << ">";
     else
         os << "<" << agent1 << ", " << agent2 << ", (" << loc1 / GRID_ROWS << "," << loc1 % GRID_ROWS << "), ("
                                                        << loc2 / GRID_ROWS << "," << loc2 % GRID_ROWS << "), " << timestep << ">";
 	return os;
 }
+
+void growConstraintTable(std::vector < std::unordered_map<int, ConstraintState > >& cons_table, size_t size)
+{
+    if (size <= cons_table.size())
+        return;
+    size_t old_size = cons_table.size();
+    cons_table.resize(size);
+    if (old_size == 0)
+        return;
+    for (auto& [loc, state] : cons_table[old_size - 1])
+    {
+        if (!state.forever)
+            continue;
+        state.forever = false;
+        for (size_t t = old_size; t < size; t++)
+            cons_table[t][loc].vertex = true;
+        cons_table[size - 1][loc].forever = true;
+    }
+}
@@ -21,39 +21,87 @@
 #include <cstring>
 #include <algorithm>
 #include <ctime>
+#include <climits>
+#include <unordered_map>
 
 
+// How a node is split on a vertex or edge conflict
+// NON_DISJOINT: each child forbids one of the agents from the conflict
+// RANDOM, SINGLETONS, WIDTH: a disjoint split on one of the agents, chosen randomly, by the narrow levels of its MDD,
+//     or by the width of its MDD at the conflict. One child makes the conflict a landmark (a positive constraint) of
+//     the agent and forbids the other agent from it, the other child forbids the agent from it.
+// DISJOINT3: a three-way disjoint split - the first agent must be at the conflict and the second mustn't, the second
+//     must and the first mustn't, or neither may
 enum split_strategy { NON_DISJOINT, RANDOM, SINGLETONS, WIDTH, DISJOINT3, SPLIT_COUNT };
 
 // Default: use the true distance to the goal location of the agent
 // DH: Differential Heuristics where all goal locations are used as pivots 
 enum lowlevel_hval { DEFAULT, DH, LLH_COUNT };
 
+// CG: minimum vertex cover of the cardinal conflict graph
+// WDG: edge-weighted minimum vertex cover of the pairwise dependency graph, where each edge is weighted by the
+//      cost increase of solving its two agents optimally together
+enum heuristics_type { CG, WDG, HEURISTICS_COUNT };
+
+// How ID-CBSH sets the threshold of its next iteration
+// MIN_EXCEEDED: the lowest f-value the last iteration cut off
+// CR: the f-value under which the cut-off nodes are predicted to make the next iteration a constant ratio larger
+//     than the last one (IDA*-CR)
+// BUDGET: the f-value predicted to fill a node budget that grows by a constant ratio every iteration, even if the
+//         iterations fall short of it
+enum threshold_growth { MIN_EXCEEDED, CR, BUDGET, GROWTH_COUNT };
+
 
 enum conflict_type { CARDINAL, SEMICARDINAL, NONCARDINAL, CONFLICT_COUNT };
 
 using namespace std;
 
 // <int loc1, int loc2, int timestep, bool positive_constraint>
-// NOTE loc2 = -1 for vertex constraints; loc2 = location2 for edge constraints
+// NOTE loc2 = -1 for vertex constraints; loc2 = location2 for edge constraints;
+//      loc2 = -2 - last_timestep for negative range constraints, which forbid being at loc1 at any of the timesteps
+//      timestep..last_timestep, where last_timestep = FOREVER for ranges that never end;
+//      loc1 = -1 for negative length constraints, where loc2 is the goal of the agent, which forbid its path to end
+//      (reach the goal and stay there) at or before timestep
 typedef std::tuple<int, int, int, bool> Constraint;
 std::ostream& operator<<(std::ostream& os, const Constraint& constraint);
+constexpr int FOREVER = INT_MAX - 2;  // the largest last_timestep a range constraint can encode
+inline bool isRangeConstraint(const Constraint& constraint) { return std::get<1>(constraint) < -1; }
+inline int rangeEnd(const Constraint& constraint) { return -2 - std::get<1>(constraint); }
+inline bool isLengthConstraint(const Constraint& constraint) { return std::get<0>(constraint) == -1; }
 
 // <int loc1, int loc2, bool positive_constraint>
 typedef std::tuple<int, int, bool> ConstraintForKnownTimestep;
 
 // <int agent1, int agent2, int loc1, int loc2, int timestep>
-// NOTE loc2 = -1 for vertex conflicts; loc2 = location2 for edge conflicts
+// NOTE loc2 = -1 for vertex conflicts; loc2 = location2 for edge conflicts;
+//      loc2 = -2 - Rg for rectangle conflicts, where loc1 = Rs, the corners of the rectangle nearest to and farthest
+//      from the agents' starts, and timestep is that of the vertex conflict the rectangle was found from;
+//      loc1 = -2 - corridor for corridor conflicts, where loc2 is the entrance of the corridor agent1 leaves it by
+//      (and agent2 enters it by), and timestep is that of the conflict the corridor conflict was found from;
+//      loc1 = -1 for target conflicts, where loc2 is the goal of agent1, which it reached at or before timestep, and
+//      agent2 is at it at timestep;
+//      loc1 = -1 and loc2 = -2 - index for mutex conflicts, where index is that of the agents' symmetric constraint
+//      sets in the conflict pool, and timestep is that of the conflict the mutex conflict was found from
 typedef std::tuple<int, int, int, int, int> Conflict;
 std::ostream& operator<<(std::ostream& os, const Conflict& conflict);
+inline bool isVertexOrEdgeConflict(const Conflict& conflict) { return std::get<2>(conflict) >= 0 && std::get<3>(conflict) >= -1; }
+inline bool isRectangleConflict(const Conflict& conflict) { return std::get<3>(conflict) < -1 && std::get<2>(conflict) >= 0; }
+inline bool isCorridorConflict(const Conflict& conflict) { return std::get<2>(conflict) < -1; }
+inline bool isTargetConflict(const Conflict& conflict) { return std::get<2>(conflict) == -1 && std::get<3>(conflict) >= 0; }
+inline bool isMutexConflict(const Conflict& conflict) { return std::get<2>(conflict) == -1 && std::get<3>(conflict) < -1; }
 
 
 struct ConstraintState
 {
     bool vertex = false;
     bool edge[5] = { false, false, false, false, false };
+    bool forever = false;  // Only set in the last timestep of a table - the vertex stays constrained after the table ends
 };
 
+// Grows a constraint table to the given size, keeping the vertices it constrains forever constrained in the timesteps
+// it gains
+void growConstraintTable(std::vector < std::unordered_map<int, ConstraintState > >& cons_table, size_t size);
+
 struct AvoidanceState
 {
     uint8_t vertex = 0;
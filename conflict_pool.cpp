@@ -0,0 +1,68 @@
+#include "conflict_pool.h"
+
+ConflictPool::ConflictPool() : chunks(new std::unique_ptr<Conflict[]>[MAX_CHUNKS]),
+                               mutex_chunks(new std::unique_ptr<MutexConstraints[]>[MAX_CHUNKS]) {}
+
+ConflictId ConflictPool::intern(const Conflict& conflict)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return internLocked(conflict);
+}
+
+ConflictId ConflictPool::internLocked(const Conflict& conflict)
+{
+	auto [it, inserted] = ids.emplace(conflict, (ConflictId)num_records.load());
+	if (inserted)
+	{
+		size_t id = num_records;
+		if ((id & (CHUNK_SIZE - 1)) == 0)
+		{
+			if ((id >> CHUNK_BITS) >= MAX_CHUNKS)
+			{
+				std::cout << "Too many conflicts for the conflict pool!" << std::endl;
+				std::abort();
+			}
+			chunks[id >> CHUNK_BITS].reset(new Conflict[CHUNK_SIZE]);
+		}
+		chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)] = conflict;
+		num_records++;
+	}
+	return it->second;
+}
+
+ConflictId ConflictPool::internMutex(int agent1, int agent2, int timestep, const vector<Constraint>& constraints1,
+                                     const vector<Constraint>& constraints2)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	MutexConstraints sets(constraints1, constraints2);
+	auto [it, inserted] = mutex_set_ids.emplace(sets, (int)num_mutex_sets);
+	if (inserted)
+	{
+		size_t index = num_mutex_sets;
+		if ((index & (CHUNK_SIZE - 1)) == 0)
+		{
+			if ((index >> CHUNK_BITS) >= MAX_CHUNKS)
+			{
+				std::cout << "Too many mutex conflicts for the conflict pool!" << std::endl;
+				std::abort();
+			}
+			mutex_chunks[index >> CHUNK_BITS].reset(new MutexConstraints[CHUNK_SIZE]);
+		}
+		mutex_chunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)] = std::move(sets);
+		num_mutex_sets++;
+	}
+	return internLocked(make_tuple(agent1, agent2, -1, -2 - it->second, timestep));
+}
+
+void ConflictPool::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < (num_records + CHUNK_SIZE - 1) >> CHUNK_BITS; i++)
+		chunks[i].reset();
+	num_records = 0;
+	ids.clear();
+	for (size_t i = 0; i < (num_mutex_sets + CHUNK_SIZE - 1) >> CHUNK_BITS; i++)
+		mutex_chunks[i].reset();
+	num_mutex_sets = 0;
+	mutex_set_ids.clear();
+}
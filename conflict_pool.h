@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// The ID of an interned conflict. CT nodes refer to their conflicts by ID, so copying the conflicts of a parent
+// node only copies ints.
+typedef int ConflictId;
+constexpr ConflictId NO_CONFLICT = -1;
+
+// Interns conflict records by value: the same conflict found in several CT nodes gets the same small integer ID.
+// Records are never freed during a search, so an ID stays valid for as long as the pool lives.
+// Several threads may intern conflicts at the same time. Records are stored in fixed-size chunks that never move, so
+// reading the record of an ID doesn't need a lock.
+class ConflictPool
+{
+public:
+	ConflictPool();
+	// Returns the ID of the given conflict, adding it to the pool if it isn't there yet
+	ConflictId intern(const Conflict& conflict);
+	inline const Conflict& operator[](ConflictId id) const { return chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)]; }
+	// Returns the ID of the mutex conflict of the two agents with the given symmetric constraint sets, adding the
+	// conflict and its sets to the pool if they aren't there yet
+	ConflictId internMutex(int agent1, int agent2, int timestep, const vector<Constraint>& constraints1,
+	                       const vector<Constraint>& constraints2);
+	// The constraint set of the first (i = 0) or second (i = 1) agent of a mutex conflict
+	inline const vector<Constraint>& mutexConstraints(const Conflict& conflict, int i) const {
+		int index = -2 - std::get<3>(conflict);
+		const MutexConstraints& sets = mutex_chunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)];
+		return i == 0 ? sets.first : sets.second;
+	}
+	inline size_t size() const { return num_records; }
+	void clear();
+
+private:
+	static constexpr int CHUNK_BITS = 12;
+	static constexpr int CHUNK_SIZE = 1 << CHUNK_BITS;
+	static constexpr int MAX_CHUNKS = 1 << 16;
+
+	struct ConflictHasher {
+		std::size_t operator()(const Conflict& c) const {
+			size_t seed = std::hash<int>()(std::get<0>(c));
+			seed ^= std::hash<int>()(std::get<1>(c)) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= std::hash<int>()(std::get<2>(c)) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= std::hash<int>()(std::get<3>(c)) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= std::hash<int>()(std::get<4>(c)) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			return seed;
+		}
+	};
+
+	// chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)] - the conflict with the given ID
+	std::unique_ptr<std::unique_ptr<Conflict[]>[]> chunks;
+	std::atomic<size_t> num_records{0};
+	std::unordered_map<Conflict, ConflictId, ConflictHasher> ids;
+	// The constraint sets of the mutex conflicts, stored like the records and referred to by their records
+	typedef std::pair<vector<Constraint>, vector<Constraint>> MutexConstraints;
+	std::unique_ptr<std::unique_ptr<MutexConstraints[]>[]> mutex_chunks;
+	size_t num_mutex_sets = 0;
+	std::map<MutexConstraints, int> mutex_set_ids;
+	std::mutex mutex;  // guards ids, mutex_set_ids and adding records
+
+	ConflictId internLocked(const Conflict& conflict);
+};
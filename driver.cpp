@@ -1,17 +1,52 @@
 ﻿#include "map_loader.h"
 #include "agents_loader.h"
 #include "ICBSSearch.h"
+#include "independence_detection.h"
 
 #include <boost/program_options.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/process.hpp>
+#include <boost/algorithm/string.hpp>
 #include "g_logging.h"
 
+#include <thread>
+
 namespace pt = boost::property_tree;
 using namespace std;
 
 int glog_v;
 
+bool parseSplitStrategy(const string& name, split_strategy& p)
+{
+	if (name == "NON_DISJOINT")
+		p = split_strategy::NON_DISJOINT;
+	else if (name == "RANDOM")
+		p = split_strategy::RANDOM;
+	else if (name == "SINGLETONS")
+		p = split_strategy::SINGLETONS;
+	else if (name == "WIDTH")
+		p = split_strategy::WIDTH;
+	else if (name == "DISJOINT3")
+		p = split_strategy::DISJOINT3;
+	else
+		return false;
+	return true;
+}
+
+string getMaxMem()
+{
+	pid_t pid = getpid();
+	char cmd[200];
+	sprintf(cmd, "cat /proc/%d/status | grep -i peak | xargs echo | cut -d' ' -f2", pid);
+	string string_cmd(cmd);
+	boost::process::ipstream pipe_stream;
+	boost::process::child child_p("/bin/bash", std::vector<std::string> {"-c", cmd}, boost::process::std_out > pipe_stream);
+	string max_mem;
+	getline(pipe_stream, max_mem);
+	child_p.wait();
+	return max_mem;
+}
+
 int main(int argc, char** argv) 
 {
     // Init GLOG.
@@ -29,8 +64,27 @@ int main(int argc, char** argv)
 		("agentNum,k", po::value<int>()->default_value(0), "number of agents")
 		("warehouseWidth,b", po::value<int>()->default_value(0), "width of working stations on both sides, for generating instances")
 		("heuristic,h", po::value<bool>()->default_value(true), "heuristics for the high-level")
+		("hType", po::value<std::string>()->default_value("CG"), "High-level heuristic (CG, WDG)")
 		("split,p", po::value<std::string>()->default_value("NON_DISJOINT"), "Split Strategy (NON_DISJOINT, RANDOM, SINGLETONS, WIDTH, DISJOINT3)")		
 		("propagation", po::value<bool>()->default_value(true), "propagate positive constraints to narrow levels down the MDD")
+		("mddCacheMB", po::value<int>()->default_value(64), "memory budget of the MDD cache in MB (0: no cache)")
+		("mddWindow", po::value<int>()->default_value(0), "classify conflicts by the MDD levels up to this many timesteps around them (0: full MDDs; ignored by the WIDTH and SINGLETONS splits)")
+		("idTableEntries", po::value<int>()->default_value(1 << 20), "entries of the ID-CBSH transposition table that carries heuristics and subtree bounds across iterations (0: no table)")
+		("thresholdGrowth", po::value<std::string>()->default_value("MIN"), "how ID-CBSH sets the threshold of the next iteration (MIN: the lowest f-value over the last threshold, CR: predicted to grow the iteration by growthRatio, BUDGET: predicted to fill a node budget that grows by growthRatio)")
+		("growthRatio", po::value<double>()->default_value(2), "how much larger each ID-CBSH iteration should be than the last one, for the CR and BUDGET threshold growth")
+		("search", po::value<std::string>()->default_value("ID"), "High-level search (ID: iterative deepening, BF: best-first, HYBRID: best-first until its budget is used up, then iterative deepening)")
+		("nodeBudget", po::value<uint64_t>()->default_value(0), "CT nodes the best-first part of a HYBRID search may generate (0: no limit)")
+		("memBudgetMB", po::value<int>()->default_value(1024), "resident memory in MB at which a HYBRID search switches to iterative deepening (0: no limit)")
+		("threads", po::value<int>()->default_value(1), "threads that expand CT nodes in parallel")
+		("parallelChildren", po::value<bool>()->default_value(false), "plan the two children of each CT node in parallel in a single-threaded best-first search")
+		("rectangle", po::value<bool>()->default_value(false), "split rectangle conflicts with barrier constraints")
+		("corridor", po::value<bool>()->default_value(false), "split corridor conflicts with range constraints")
+		("target", po::value<bool>()->default_value(false), "split target conflicts with length constraints")
+		("mutex", po::value<bool>()->default_value(false), "find cardinal conflicts with mutex propagation on MDD pairs")
+		("mergeThreshold", po::value<int>()->default_value(-1), "merge two meta-agents after they conflicted more than this many times on a branch (-1: never; best-first search with NON_DISJOINT splits only)")
+		("bypass", po::value<bool>()->default_value(false), "adopt the paths of a child instead of branching when they cost the same and have fewer conflicts, in a single-threaded best-first search")
+		("independence", po::value<int>()->default_value(0), "split the agents into independent groups with independence detection, and solve this many groups concurrently, each with its own search (0: plan all the agents jointly). Its results have their own columns.")
+		("portfolio", po::value<std::string>()->implicit_value("WIDTH/ID,RANDOM/ID,SINGLETONS/ID,NON_DISJOINT/BF"), "run a search for each comma-separated SPLIT/SEARCH member concurrently, and stop all of them when one is solved (default members: WIDTH/ID,RANDOM/ID,SINGLETONS/ID,NON_DISJOINT/BF)")
 		("screen", po::value<int>()->default_value(0), "screen (0: only results; 1: details)")
 		("cutoffTime", po::value<int>()->default_value(300), "cutoff time (seconds)")
 		("seed", po::value<int>()->default_value(0), "random seed")
@@ -61,17 +115,7 @@ int main(int argc, char** argv)
 
 	
 	split_strategy p;
-	if (vm["split"].as<string>() == "NON_DISJOINT")
-		p = split_strategy::NON_DISJOINT;
-	else if (vm["split"].as<string>() == "RANDOM")
-		p = split_strategy::RANDOM;
-	else if (vm["split"].as<string>() == "SINGLETONS")
-		p = split_strategy::SINGLETONS;
-	else if (vm["split"].as<string>() == "WIDTH")
-		p = split_strategy::WIDTH;
-	else if (vm["split"].as<string>() == "DISJOINT3")
-		p = split_strategy::DISJOINT3;
-	else
+	if (!parseSplitStrategy(vm["split"].as<string>(), p))
 	{
 		cout << "ERROR SPLIT STRATEGY!";
 		return 0;
@@ -79,32 +123,182 @@ int main(int argc, char** argv)
 	if (vm["split"].as<string>() != "NON_DISJOINT")
 		cout << vm["split"].as<string>() << "+";
 
+	heuristics_type h_type;
+	if (vm["hType"].as<string>() == "CG")
+		h_type = heuristics_type::CG;
+	else if (vm["hType"].as<string>() == "WDG")
+		h_type = heuristics_type::WDG;
+	else
+	{
+		cout << "ERROR HEURISTIC TYPE!";
+		return 0;
+	}
+	if (vm["heuristic"].as<bool>() && h_type != heuristics_type::CG)
+		cout << vm["hType"].as<string>() << "+";
+
+	threshold_growth growth;
+	if (vm["thresholdGrowth"].as<string>() == "MIN")
+		growth = threshold_growth::MIN_EXCEEDED;
+	else if (vm["thresholdGrowth"].as<string>() == "CR")
+		growth = threshold_growth::CR;
+	else if (vm["thresholdGrowth"].as<string>() == "BUDGET")
+		growth = threshold_growth::BUDGET;
+	else
+	{
+		cout << "ERROR THRESHOLD GROWTH!";
+		return 0;
+	}
+
+	auto configure = [&](ICBSSearch& search) {
+		search.posConstraintsAlsoAddPosConstraintsOnMddNarrowLevelsLeadingToThem = vm["propagation"].as<bool>();
+		search.heuristic_type = h_type;
+		search.mdd_cache_max_bytes = (size_t)vm["mddCacheMB"].as<int>() << 20;
+		search.id_table_max_entries = (size_t)vm["idTableEntries"].as<int>();
+		search.growth = growth;
+		search.growth_ratio = vm["growthRatio"].as<double>();
+		search.bf_node_budget = vm["nodeBudget"].as<uint64_t>();
+		search.bf_memory_budget_kb = (size_t)vm["memBudgetMB"].as<int>() << 10;
+		search.mdd_window = vm["mddWindow"].as<int>();
+		search.num_threads = vm["threads"].as<int>();
+		search.parallel_children = vm["parallelChildren"].as<bool>();
+		search.bypass = vm["bypass"].as<bool>();
+		search.rectangle_reasoning = vm["rectangle"].as<bool>();
+		search.corridor_reasoning = vm["corridor"].as<bool>();
+		search.target_reasoning = vm["target"].as<bool>();
+		search.mutex_reasoning = vm["mutex"].as<bool>();
+		search.merge_threshold = vm["mergeThreshold"].as<int>();
+	};
+	string h_suffix;
+	if (vm["heuristic"].as<bool>() && h_type != heuristics_type::CG)
+		h_suffix = "+" + vm["hType"].as<string>();
+
+	if (vm["independence"].as<int>() > 0)
+	{
+		// The agents are split into groups that are planned separately. No search plans all of them jointly.
+		string search_type = vm["search"].as<string>();
+		if (search_type != "BF" && search_type != "ID" && search_type != "HYBRID")
+		{
+			cout << "ERROR SEARCH!";
+			return 0;
+		}
+		bool heuristic = vm["heuristic"].as<bool>();
+		int screen = vm["screen"].as<int>();
+		IndependenceDetection independence(ml, al,
+			[&](const AgentsLoader& group_al, int cutoff_time) {
+				std::unique_ptr<ICBSSearch> search(new ICBSSearch(ml, group_al, 1.0, p, heuristic, cutoff_time, screen));
+				configure(*search);
+				return search;
+			},
+			[&search_type](ICBSSearch& search) {
+				if (search_type == "BF")
+					return search.runICBSSearch();
+				else if (search_type == "HYBRID")
+					return search.runHybridICBSSearch();
+				return search.runIterativeDeepeningICBSSearch();
+			},
+			vm["independence"].as<int>(), vm["cutoffTime"].as<int>());
+		independence.run();
+		independence.max_mem = getMaxMem();
+		independence.printResults();
+#ifndef LPA
+		independence.saveResults(vm["output"].as<string>(), vm["agents"].as<string>(),
+		                         "independence(" + vm["split"].as<string>() + h_suffix + ")");
+#else
+		independence.saveResults(vm["output"].as<string>(), vm["agents"].as<string>(),
+		                         "independence(" + vm["split"].as<string>() + h_suffix + ")/LPA*");
+#endif
+		return 0;
+	}
+
 	ICBSSearch icbs(ml, al, 1.0, p, vm["heuristic"].as<bool>(), vm["cutoffTime"].as<int>(), vm["screen"].as<int>());
-	icbs.posConstraintsAlsoAddPosConstraintsOnMddNarrowLevelsLeadingToThem = vm["propagation"].as<bool>();
+	configure(icbs);
+
+	if (vm.count("portfolio"))
+	{
+		// Each member starts from a copy of icbs's root node. icbs itself isn't run.
+		vector<string> names;
+		boost::split(names, vm["portfolio"].as<string>(), boost::is_any_of(","));
+		vector<std::unique_ptr<ICBSSearch>> members;
+		vector<bool> best_first;
+		for (const string& name : names)
+		{
+			vector<string> parts;
+			boost::split(parts, name, boost::is_any_of("/"));
+			split_strategy member_split;
+			if (parts.size() != 2 || !parseSplitStrategy(parts[0], member_split) ||
+			    (parts[1] != "BF" && parts[1] != "ID"))
+			{
+				cout << "ERROR PORTFOLIO MEMBER " << name << "!";
+				return 0;
+			}
+			members.emplace_back(new ICBSSearch(icbs, member_split));
+			members.back()->num_threads = icbs.num_threads;
+			members.back()->parallel_children = icbs.parallel_children;
+			best_first.push_back(parts[1] == "BF");
+		}
+		vector<std::thread> threads;
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			threads.emplace_back([&members, &best_first, i] {
+				ICBSSearch& member = *members[i];
+				bool solved = best_first[i] ? member.runICBSSearch() : member.runIterativeDeepeningICBSSearch();
+				if (solved)  // Optimal - the other members have nothing to add
+					member.cancel();
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		string max_mem = getMaxMem();
+		size_t winner = 0;
+		while (winner < members.size() - 1 && !members[winner]->solution_found)
+			winner++;
+		members[winner]->isFeasible();
+		for (size_t i = 0; i < members.size(); i++)
+		{
+			members[i]->max_mem = max_mem;
+			std::cout << "Portfolio member " << names[i] << ":" << std::endl;
+			members[i]->printResults();
+#ifndef LPA
+			members[i]->saveResults(vm["output"].as<string>(), vm["agents"].as<string>(),
+			                        "portfolio(" + names[i] + ")" + h_suffix);
+#else
+			members[i]->saveResults(vm["output"].as<string>(), vm["agents"].as<string>(),
+			                        "portfolio(" + names[i] + ")" + h_suffix + "/LPA*");
+#endif
+		}
+		std::cout << "Portfolio winner " << names[winner] << ":" << std::endl;
+		members[winner]->printResults();
+		return 0;
+	}
+
 	// run 
-	//icbs.runICBSSearch();
-	icbs.runIterativeDeepeningICBSSearch();
+	if (vm["search"].as<string>() == "BF")
+		icbs.runICBSSearch();
+	else if (vm["search"].as<string>() == "ID")
+		icbs.runIterativeDeepeningICBSSearch();
+	else if (vm["search"].as<string>() == "HYBRID")
+		icbs.runHybridICBSSearch();
+	else
+	{
+		cout << "ERROR SEARCH!";
+		return 0;
+	}
 	// validate the solution
 	icbs.isFeasible();
 	// save data:
 	// 1. Get max memory
-	pid_t pid = getpid();
-	char cmd[200];
-	sprintf(cmd, "cat /proc/%d/status | grep -i peak | xargs echo | cut -d' ' -f2", pid);
-	string string_cmd(cmd);
-	boost::process::ipstream pipe_stream;
-	boost::process::child child_p("/bin/bash", std::vector<std::string> {"-c", cmd}, boost::process::std_out > pipe_stream);
-	getline(pipe_stream, icbs.max_mem);
-	child_p.wait();
+	icbs.max_mem = getMaxMem();
 
     // 2. print results
 	icbs.printResults();
 
 	// 3. save results to file
+	string solver = vm["split"].as<string>() + h_suffix;
 #ifndef LPA
-	icbs.saveResults(vm["output"].as<string>(), vm["agents"].as<string>(), vm["split"].as<string>());
+	icbs.saveResults(vm["output"].as<string>(), vm["agents"].as<string>(), solver);
 #else
-	icbs.saveResults(vm["output"].as<string>(), vm["agents"].as<string>(), vm["split"].as<string>()+"/LPA*");
+	icbs.saveResults(vm["output"].as<string>(), vm["agents"].as<string>(), solver+"/LPA*");
 #endif
 
 	return 0;
@@ -0,0 +1,259 @@
+#include "independence_detection.h"
+
+#include <fstream>
+#include <filesystem>
+
+IndependenceDetection::IndependenceDetection(const MapLoader& ml, const AgentsLoader& al, SearchFactory make_search,
+                                             SearchRunner run_search, int num_threads, int cutoffTime):
+	ml(ml), al(al), make_search(std::move(make_search)), run_search(std::move(run_search)), pool(num_threads),
+	time_limit(cutoffTime), goal_distances(al.num_of_agents)
+{
+}
+
+bool IndependenceDetection::run()
+{
+	wall_start = std::chrono::system_clock::now();
+	vector<int> to_solve;
+	for (int i = 0; i < al.num_of_agents; i++)
+	{
+		groups.emplace_back();
+		groups.back().id = next_group_id++;
+		groups.back().agents.push_back(i);
+		to_solve.push_back(i);
+	}
+
+	while (true)
+	{
+		if (!solveGroups(to_solve))
+		{
+			wall_runtime = std::chrono::system_clock::now() - wall_start;
+			return false;
+		}
+
+		// Resolve the conflicts between the groups. Each group takes part in at most one resolution per round, so the
+		// merged groups are disjoint, and the groups replanned in this round are checked again in the next one.
+		vector<bool> touched(groups.size(), false);
+		vector<bool> merged(groups.size(), false);
+		vector<Group> new_groups;
+		for (int i = 0; i < (int)groups.size(); i++)
+		{
+			for (int j = i + 1; j < (int)groups.size() && !touched[i]; j++)
+			{
+				if (touched[j] || !conflicting(groups[i], groups[j]))
+					continue;
+				touched[i] = touched[j] = true;
+				auto key = std::minmax(groups[i].id, groups[j].id);
+				if (replanned.count(key) == 0 &&
+				    ((groups[i].agents.size() == 1 && replanToAvoid(groups[i], groups[j])) ||
+				     (groups[j].agents.size() == 1 && replanToAvoid(groups[j], groups[i]))))
+				{
+					replanned.insert(key);
+					num_replans++;
+					continue;
+				}
+				merged[i] = merged[j] = true;
+				new_groups.emplace_back();
+				new_groups.back().id = next_group_id++;
+				std::merge(groups[i].agents.begin(), groups[i].agents.end(),
+				           groups[j].agents.begin(), groups[j].agents.end(),
+				           std::back_inserter(new_groups.back().agents));
+				num_merges++;
+			}
+		}
+		if (std::find(touched.begin(), touched.end(), true) == touched.end())
+			break;
+
+		vector<Group> kept;
+		for (int i = 0; i < (int)groups.size(); i++)
+			if (!merged[i])
+				kept.push_back(std::move(groups[i]));
+		to_solve.clear();
+		for (auto& group : new_groups)
+		{
+			to_solve.push_back((int)kept.size());
+			kept.push_back(std::move(group));
+		}
+		groups.swap(kept);
+	}
+
+	solution_found = true;
+	solution_cost = 0;
+	for (const auto& group : groups)
+		solution_cost += group.cost;
+	wall_runtime = std::chrono::system_clock::now() - wall_start;
+	return true;
+}
+
+// Solves the groups with the given indices concurrently. Returns false if any of them wasn't solved.
+bool IndependenceDetection::solveGroups(const vector<int>& to_solve)
+{
+	vector<char> solved(to_solve.size(), false);
+	for (size_t i = 0; i < to_solve.size(); i++)
+		pool.submit([this, &to_solve, &solved, i](int) {
+			solved[i] = solveGroup(groups[to_solve[i]]);
+		});
+	pool.wait();
+	return std::find(solved.begin(), solved.end(), false) == solved.end();
+}
+
+bool IndependenceDetection::solveGroup(Group& group)
+{
+	auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - wall_start);
+	int remaining = time_limit - (int)elapsed.count();
+	if (remaining <= 0)
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		timed_out = true;
+		return false;
+	}
+	AgentsLoader group_al;
+	group_al.num_of_agents = (int)group.agents.size();
+	for (int ag : group.agents)
+	{
+		group_al.initial_locations.push_back(al.initial_locations[ag]);
+		group_al.goal_locations.push_back(al.goal_locations[ag]);
+	}
+	std::unique_ptr<ICBSSearch> search = make_search(group_al, remaining);
+	search->runs_concurrently = true;
+	bool solved = run_search(*search);
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		num_searches++;
+		HL_num_expanded += search->HL_num_expanded;
+		HL_num_generated += search->HL_num_generated;
+		if (!solved && search->timedOut())
+			timed_out = true;
+	}
+	if (!solved)
+		return false;
+	group.cost = search->solution_cost;
+	group.paths.resize(group.agents.size());
+	for (int i = 0; i < (int)group.agents.size(); i++)
+	{
+		group.paths[i].clear();
+		for (const auto& entry : search->getPath(i))
+			group.paths[i].push_back(entry.location);
+	}
+	return true;
+}
+
+// Whether any agent of one group has a vertex or edge conflict with any agent of the other. Agents stay at their goals
+// after their paths end.
+bool IndependenceDetection::conflicting(const Group& group1, const Group& group2) const
+{
+	for (const auto& path1 : group1.paths)
+	{
+		for (const auto& path2 : group2.paths)
+		{
+			int makespan = (int)max(path1.size(), path2.size());
+			for (int t = 0; t < makespan; t++)
+			{
+				if (locationAt(path1, t) == locationAt(path2, t))
+					return true;
+				if (t > 0 && locationAt(path1, t) == locationAt(path2, t - 1) &&
+				    locationAt(path1, t - 1) == locationAt(path2, t))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Looks for another path of the single agent of the group, of the same cost, that doesn't conflict with the paths of
+// the other group, by searching the space-time graph of the locations that are close enough to the goal to reach it
+// in time. Replaces the agent's path and returns true if one was found.
+bool IndependenceDetection::replanToAvoid(Group& group, const Group& other)
+{
+	int ag = group.agents[0];
+	int start = group.paths[0].front();
+	int goal = group.paths[0].back();
+	int cost = group.cost;
+	for (const auto& path : other.paths)
+		for (int t = cost; t < max(cost + 1, (int)path.size()); t++)
+			if (locationAt(path, t) == goal)  // the agent can't finish at its goal by then
+				return false;
+
+	vector<int>& h = goal_distances[ag];
+	if (h.empty())
+		HeuristicCalculator(start, goal, ml.my_map, ml.rows, ml.cols, ml.moves_offset).getHVals(h);
+	auto blocked = [&other](int from, int to, int t) {
+		for (const auto& path : other.paths)
+			if (locationAt(path, t) == to || (locationAt(path, t - 1) == to && locationAt(path, t) == from))
+				return true;
+		return false;
+	};
+
+	// The locations the agent can be at each timestep, and where it came from
+	vector<std::unordered_map<int, int>> parents(cost + 1);
+	parents[0][start] = -1;
+	for (int t = 1; t <= cost; t++)
+	{
+		for (const auto& [loc, parent] : parents[t - 1])
+		{
+			for (int direction = 0; direction < MapLoader::MOVE_COUNT; direction++)
+			{
+				int next_loc = loc + ml.moves_offset[direction];
+				if (next_loc < 0 || next_loc >= (int)ml.map_size() || ml.my_map[next_loc] ||
+				    abs(next_loc % ml.cols - loc % ml.cols) > 1 || h[next_loc] > cost - t ||
+				    parents[t].count(next_loc) || blocked(loc, next_loc, t))
+					continue;
+				parents[t][next_loc] = loc;
+			}
+		}
+		if (parents[t].empty())
+			return false;
+	}
+	if (parents[cost].count(goal) == 0)
+		return false;
+
+	vector<int>& path = group.paths[0];
+	int loc = goal;
+	for (int t = cost; t >= 0; t--)
+	{
+		path[t] = loc;
+		loc = parents[t][loc];
+	}
+	return true;
+}
+
+void IndependenceDetection::printResults() const
+{
+	std::cout << "Status,Cost,Groups,Largest Group,Group Searches,Replans,Merges,HL Expanded,HL Generated,"
+	             "Wall Runtime,Max Mem (kB)" << std::endl;
+	if (solution_found)
+		std::cout << "Optimal,";
+	else if (timed_out)
+		std::cout << "Timeout,";
+	else
+		std::cout << "No solutions,";
+	size_t largest = 0;
+	for (const auto& group : groups)
+		largest = max(largest, group.agents.size());
+	std::cout << solution_cost << "," << groups.size() << "," << largest << "," <<
+		num_searches << "," << num_replans << "," << num_merges << "," <<
+		HL_num_expanded << "," << HL_num_generated << "," <<
+		((float) wall_runtime.count()) / 1000000000 << "," <<
+		max_mem << std::endl;
+}
+
+void IndependenceDetection::saveResults(const string& outputFile, const string& agentFile, const string& solver) const
+{
+	ofstream stats;
+	if (std::filesystem::exists(outputFile) == false)
+	{
+		stats.open(outputFile);
+		stats << "Cost,Groups,Largest Group,Group Searches,Replans,Merges,HL Expanded,HL Generated,"
+		         "Wall Runtime,Max Mem (kB),solver,instance" << std::endl;
+	}
+	else
+		stats.open(outputFile, ios::app);
+	size_t largest = 0;
+	for (const auto& group : groups)
+		largest = max(largest, group.agents.size());
+	stats << solution_cost << "," << groups.size() << "," << largest << "," <<
+		num_searches << "," << num_replans << "," << num_merges << "," <<
+		HL_num_expanded << "," << HL_num_generated << "," <<
+		((float) wall_runtime.count()) / 1000000000 << "," <<
+		max_mem << "," << solver << "," << agentFile << endl;
+	stats.close();
+}
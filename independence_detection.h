@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <set>
+
+#include "ICBSSearch.h"
+
+// Independence detection (Standley 2010) in front of the high-level search: each agent starts in a group of its own,
+// and every group is solved with its own ICBSSearch. When the paths of two groups conflict, one of them is replanned
+// to avoid the paths of the other at the same cost. If that fails, or the two groups already conflicted once, they're
+// merged into a single group that's solved jointly. This repeats until the paths of all the groups are conflict-free,
+// so the sum of the costs of the groups is the optimal cost.
+// The groups that need to be solved in a round are disjoint, so they're solved concurrently on a thread pool.
+class IndependenceDetection
+{
+public:
+	// Builds a configured search of the given agents, with the given cutoff time in seconds
+	typedef std::function<std::unique_ptr<ICBSSearch>(const AgentsLoader&, int)> SearchFactory;
+	// Runs a search, and returns whether it found a solution
+	typedef std::function<bool(ICBSSearch&)> SearchRunner;
+
+	IndependenceDetection(const MapLoader& ml, const AgentsLoader& al, SearchFactory make_search,
+	                      SearchRunner run_search, int num_threads, int cutoffTime);
+	bool run();
+	void printResults() const;
+	void saveResults(const string& outputFile, const string& agentFile, const string& solver) const;
+
+	// statistics
+	bool solution_found = false;
+	bool timed_out = false;
+	int solution_cost = -1;
+	uint64_t num_searches = 0;  // of groups, including the ones that were later merged
+	uint64_t num_replans = 0;  // conflicts between groups resolved by replanning a single-agent group
+	uint64_t num_merges = 0;
+	uint64_t HL_num_expanded = 0;  // by all the searches
+	uint64_t HL_num_generated = 0;
+	std::chrono::nanoseconds wall_runtime = std::chrono::nanoseconds::zero();
+	string max_mem;
+
+private:
+	struct Group {
+		int id;  // unique over the whole run, unlike the group's index
+		vector<int> agents;
+		vector<vector<int>> paths;  // the locations of each agent in the group, in the order of agents
+		int cost = -1;
+	};
+
+	const MapLoader& ml;
+	const AgentsLoader& al;
+	SearchFactory make_search;
+	SearchRunner run_search;
+	TaskPool pool;
+	int time_limit;
+	std::chrono::system_clock::time_point wall_start;
+	vector<Group> groups;
+	int next_group_id = 0;
+	std::set<pair<int, int>> replanned;  // ids of pairs of groups whose conflict was resolved by replanning
+	vector<vector<int>> goal_distances;  // of each agent, computed when it's first replanned
+	std::mutex stats_mutex;
+
+	bool solveGroups(const vector<int>& to_solve);
+	bool solveGroup(Group& group);
+	bool conflicting(const Group& group1, const Group& group2) const;
+	bool replanToAvoid(Group& group, const Group& other);
+	inline static int locationAt(const vector<int>& path, int timestep) {
+		return timestep < (int)path.size() ? path[timestep] : path.back();
+	}
+};
@@ -4,6 +4,7 @@
 #include <vector>
 #include <list>
 #include <utility>
+#include <algorithm>
 #include <boost/heap/fibonacci_heap.hpp>
 #include <sparsehash/dense_hash_map>
 #include "lpa_node.h"
@@ -167,26 +168,7 @@ void LPAStar::popVertexConstraint(int loc_id, int ts, const std::vector < std::u
             // along with updating goal_n, because this node is an improved goal
 
             // Update min_goal_timestep
-            this->min_goal_timestep = 0;
-
-            for (int j = ts - 1; j >= start_n->h_; --j) {  // Constraints on entering the goal earlier than it can be reached are meaningless
-                bool all_blocked = true;
-                for (int direction = 4; direction >= 0; direction--) {
-                    auto pred_loc_id = loc_id + actions_offset[direction];
-                    if (0 <= pred_loc_id && pred_loc_id < map_rows * map_cols &&  // valid row
-                        !my_map[pred_loc_id] &&  // valid edge - not from an obstacle
-                        abs(pred_loc_id % map_cols - loc_id % map_cols) < 2 &&  // valid column
-                        !dcm.isDynCons(pred_loc_id, loc_id, j)  // the edge isn't constrained
-                            ) {
-                        all_blocked = false;
-                        break;
-                    }
-                }
-                if (all_blocked) {
-                    this->min_goal_timestep = j + 1;
-                    break;
-                }
-            }
+            this->min_goal_timestep = minGoalTimestepUpTo(ts - 1);
         }
         else {
             // No need to call updateGoal - this isn't an allowed goal at the moment
@@ -209,6 +191,129 @@ void LPAStar::popVertexConstraint(int loc_id, int ts, const std::vector < std::u
     }
 
 }
+
+void LPAStar::addVertexRangeConstraint(int loc_id, int first_ts, int last_ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat)
+{
+    if (last_ts == FOREVER) {
+        // The dcm can't hold constraints on infinitely many timesteps - such a constraint is checked separately
+        // (isConstrainedForever). Invalidate the nodes already generated in it, like addVertexConstraint does,
+        // and update their successors.
+        forever_constraints.emplace_back(loc_id, first_ts);
+        vector<LPANode*> invalidated = nodesFrom(loc_id, first_ts);
+        for (LPANode* n : invalidated) {
+            n->initState();
+            if (n->in_openlist_ == true) {
+                openlistRemove(n);
+            }
+        }
+        for (LPANode* n : invalidated) {
+            for (int direction = 0; direction < 5; direction++) {
+                auto succ_loc_id = loc_id + actions_offset[direction];
+                if (0 <= succ_loc_id && succ_loc_id < map_rows*map_cols && !my_map[succ_loc_id] &&
+                    abs(succ_loc_id % map_cols - loc_id % map_cols) < 2) {
+                    updateState(retrieveNode(succ_loc_id, n->t_+1).second, cat, false);
+                }
+            }
+        }
+        return;
+    }
+    for (int ts = first_ts; ts <= last_ts; ts++)
+        addVertexConstraint(loc_id, ts, cat);
+}
+
+void LPAStar::popVertexRangeConstraint(int loc_id, int first_ts, int last_ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat)
+{
+    if (last_ts == FOREVER) {
+        forever_constraints.pop_back();
+        // Expanded predecessors didn't generate the nodes at the location while it was blocked, so update (and
+        // generate) the node after each generated predecessor, not just the nodes that were generated before.
+        vector<int> timesteps;
+        for (int direction = 0; direction < 5; direction++) {
+            auto pred_loc_id = loc_id - actions_offset[direction];
+            if (0 <= pred_loc_id && pred_loc_id < map_rows*map_cols && !my_map[pred_loc_id] &&
+                abs(pred_loc_id % map_cols - loc_id % map_cols) < 2) {
+                for (LPANode* pred_n : nodesFrom(pred_loc_id, first_ts - 1))
+                    timesteps.push_back(pred_n->t_ + 1);
+            }
+        }
+        std::sort(timesteps.begin(), timesteps.end());
+        timesteps.erase(std::unique(timesteps.begin(), timesteps.end()), timesteps.end());
+        for (int ts : timesteps)
+            updateState(retrieveNode(loc_id, ts).second, cat, false);
+        return;
+    }
+    for (int ts = last_ts; ts >= first_ts; ts--)  // The dcm expects constraints to be popped in reverse order
+        popVertexConstraint(loc_id, ts, cat);
+}
+
+void LPAStar::addLengthConstraint(int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat)
+{
+    length_constraints.push_back(ts);
+    if (min_goal_timestep >= ts + 1)
+        return;
+    min_goal_timestep = ts + 1;
+    for (LPANode *possible_goal : possible_goals) {
+        if (possible_goal->t_ >= min_goal_timestep) {
+            goal_n = possible_goal;
+            break;
+        }
+    }
+    // Unlike a constraint on staying at the goal, this one doesn't invalidate any node, so the goal nodes that are
+    // allowed now wouldn't be updated. They may be better goals than the ones in possible_goals, which only has the
+    // goal nodes that were better than goal_n when they were updated.
+    for (LPANode* n : nodesFrom(goal_location, min_goal_timestep))
+        updateState(n, cat, false);
+}
+
+void LPAStar::popLengthConstraint(int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat)
+{
+    length_constraints.pop_back();
+    if (min_goal_timestep != ts + 1)
+        return;  // A later constraint still keeps the path from ending
+    min_goal_timestep = minGoalTimestepUpTo(ts);
+    // The goal nodes up to ts are allowed goals again
+    for (LPANode* n : nodesFrom(goal_location, min_goal_timestep)) {
+        if (n->t_ > ts)
+            break;
+        updateState(n, cat, false);
+    }
+}
+
+int LPAStar::minGoalTimestepUpTo(int last_ts)
+{
+    int retVal = 0;
+    for (int length_ts : length_constraints)
+        retVal = std::max(retVal, length_ts + 1);
+    for (int j = last_ts; j >= start_n->h_ && j >= retVal; --j) {  // Constraints on entering the goal earlier than it can be reached are meaningless
+        bool all_blocked = true;
+        for (int direction = 4; direction >= 0; direction--) {
+            auto pred_loc_id = goal_location - actions_offset[direction];
+            if (0 <= pred_loc_id && pred_loc_id < map_rows * map_cols &&  // valid row
+                !my_map[pred_loc_id] &&  // valid edge - not from an obstacle
+                abs(pred_loc_id % map_cols - goal_location % map_cols) < 2 &&  // valid column
+                !dcm.isDynCons(pred_loc_id, goal_location, j)  // the edge isn't constrained
+                    ) {
+                all_blocked = false;
+                break;
+            }
+        }
+        if (all_blocked)
+            return j + 1;
+    }
+    return retVal;
+}
+
+vector<LPANode*> LPAStar::nodesFrom(int loc_id, int first_ts)
+{
+    vector<LPANode*> retVal;  // Collected first - updating them may generate more nodes at the location
+    if (allNodes_table.data[loc_id] == nullptr)
+        return retVal;
+    for (auto [t, n] : *allNodes_table.data[loc_id]) {
+        if (t >= first_ts)
+            retVal.push_back(n);
+    }
+    return retVal;
+}
 // ----------------------------------------------------------------------------
 
 
@@ -299,6 +404,17 @@ inline LPANode* LPAStar::openlistPopHead() {
 // ----------------------------------------------------------------------------
 
 
+// ----------------------------------------------------------------------------
+inline bool LPAStar::isConstrainedForever(int loc_id, int t) const {
+  for (const auto& [constrained_loc_id, first_ts] : forever_constraints) {
+    if (constrained_loc_id == loc_id && t >= first_ts)
+      return true;
+  }
+  return false;
+}
+// ----------------------------------------------------------------------------
+
+
 // ----------------------------------------------------------------------------
 inline void LPAStar::releaseNodesMemory() {
 //  for (auto n : allNodes_table) {
@@ -325,12 +441,15 @@ inline void LPAStar::printAllNodesTable() {
 inline LPANode* LPAStar::retrieveMinPred(LPANode* n) {
   VLOG(11) << "\t\t\t\tretrieveMinPred: before " << n->nodeString();
   LPANode* retVal = nullptr;
+  if (isConstrainedForever(n->loc_id_, n->t_))
+    return retVal;
   auto best_vplusc_val = std::numeric_limits<float>::max();
   for (int direction = 0; direction < 5; direction++) {
     auto pred_loc_id = n->loc_id_ - actions_offset[direction];
     if (0 <= pred_loc_id && pred_loc_id < map_rows*map_cols && !my_map[pred_loc_id] &&
         abs(pred_loc_id % map_cols - n->loc_id_ % map_cols) < 2 &&
-        !dcm.isDynCons(pred_loc_id,n->loc_id_,n->t_)) {
+        !dcm.isDynCons(pred_loc_id,n->loc_id_,n->t_) &&
+        !isConstrainedForever(pred_loc_id, n->t_-1)) {
       auto [existed_before, pred_n] = retrieveNode(pred_loc_id, n->t_-1); // n->t_ - 1 is pred_timestep
       if (
           retVal == nullptr ||
@@ -414,7 +533,7 @@ inline void LPAStar::updateState(LPANode* n, const std::vector < std::unordered_
 
 
 // ----------------------------------------------------------------------------
-bool LPAStar::findPath(const std::vector < std::unordered_map<int, AvoidanceState > >& cat, int fLowerBound, int lastGoalConstraintTimestep) {
+bool LPAStar::findPath(const std::vector < std::unordered_map<int, AvoidanceState > >& cat, int, int lastGoalConstraintTimestep) {
 
   search_iterations++;
   num_expanded.push_back(0);
@@ -439,7 +558,8 @@ bool LPAStar::findPath(const std::vector < std::unordered_map<int, AvoidanceStat
         auto next_loc_id = curr->loc_id_ + actions_offset[direction];
         if (0 <= next_loc_id && next_loc_id < map_rows*map_cols && !my_map[next_loc_id] &&
             abs(next_loc_id % map_cols - curr->loc_id_ % map_cols) < 2 &&
-            !dcm.isDynCons(curr->loc_id_, next_loc_id , curr->t_+1)) {
+            !dcm.isDynCons(curr->loc_id_, next_loc_id , curr->t_+1) &&
+            !isConstrainedForever(next_loc_id, curr->t_+1)) {
             auto next_n = retrieveNode(next_loc_id, curr->t_+1);
             if (next_n.second->g_ > curr->v_ + 1) {
                 next_n.second->bp_ = curr;
@@ -456,7 +576,8 @@ bool LPAStar::findPath(const std::vector < std::unordered_map<int, AvoidanceStat
         auto next_loc_id = curr->loc_id_ + actions_offset[direction];
         if (0 <= next_loc_id && next_loc_id < map_rows*map_cols && !my_map[next_loc_id] &&
             abs(next_loc_id % map_cols - curr->loc_id_ % map_cols) < 2 &&
-            !dcm.isDynCons(curr->loc_id_, next_loc_id , curr->t_+1)) {
+            !dcm.isDynCons(curr->loc_id_, next_loc_id , curr->t_+1) &&
+            !isConstrainedForever(next_loc_id, curr->t_+1)) {
           auto next_n = retrieveNode(next_loc_id, curr->t_+1);
           updateState(next_n.second, cat, false);
         }
@@ -474,6 +595,42 @@ bool LPAStar::findPath(const std::vector < std::unordered_map<int, AvoidanceStat
 // ----------------------------------------------------------------------------
 
 
+// ----------------------------------------------------------------------------
+bool LPAStar::getMDDWidths(vector<int>& widths) {
+  // The termination condition of findPath. Once it holds, every node with a key lower than (or, because ties are
+  // broken towards lower g-values, equal to) the goal's is consistent, and the nodes of the MDD are such nodes.
+  bool settled = (open_list.empty() || nodes_comparator(open_list.top(), goal_n)) && goal_n->v_ >= goal_n->g_;
+  if (!settled || goal_n->g_ == std::numeric_limits<float>::max())
+    return false;
+  int cost = goal_n->t_;
+  widths.assign(cost + 1, 0);
+  widths[cost] = 1;
+  vector<LPANode*> level = {goal_n};
+  vector<LPANode*> prev_level;
+  for (int t = cost; t > 0; t--) {
+    prev_level.clear();
+    for (LPANode* n : level) {
+      for (int direction = 0; direction < 5; direction++) {
+        auto pred_loc_id = n->loc_id_ - actions_offset[direction];
+        if (0 <= pred_loc_id && pred_loc_id < map_rows*map_cols && !my_map[pred_loc_id] &&
+            abs(pred_loc_id % map_cols - n->loc_id_ % map_cols) < 2 &&
+            !dcm.isDynCons(pred_loc_id, n->loc_id_, t)) {
+          auto [exists, pred_n] = allNodes_table.get(pred_loc_id, t-1);
+          if (exists && pred_n->v_ == pred_n->g_ && pred_n->g_ == t-1)  // On a shortest path to n
+            prev_level.push_back(pred_n);
+        }
+      }
+    }
+    std::sort(prev_level.begin(), prev_level.end());
+    prev_level.erase(std::unique(prev_level.begin(), prev_level.end()), prev_level.end());
+    widths[t-1] = (int)prev_level.size();
+    level.swap(prev_level);
+  }
+  return true;
+}
+// ----------------------------------------------------------------------------
+
+
 // ----------------------------------------------------------------------------
 string LPAStar::openToString(bool print_priorities) const {
   string retVal;
@@ -501,6 +658,8 @@ map_cols(other.map_cols),
 actions_offset(other.actions_offset),
 dcm(other.dcm),
 min_goal_timestep(other.min_goal_timestep),
+length_constraints(other.length_constraints),
+forever_constraints(other.forever_constraints),
 agent_id(other.agent_id),
 allNodes_table(other.allNodes_table.xy_size)
 {
@@ -539,10 +698,8 @@ allNodes_table(other.allNodes_table.xy_size)
         }
     }
     // Update start and goal nodes.
-    auto [found_start, start_n] = allNodes_table.get(other.start_n->loc_id_, other.start_n->t_);
-    start_n = start_n;
-    auto [found_goal, goal_n] = allNodes_table.get(other.goal_n->loc_id_, other.goal_n->t_);
-    goal_n = goal_n;
+    start_n = std::get<1>(allNodes_table.get(other.start_n->loc_id_, other.start_n->t_));
+    goal_n = std::get<1>(allNodes_table.get(other.goal_n->loc_id_, other.goal_n->t_));
 
     for (auto possible_goal : other.possible_goals)
     {
@@ -48,6 +48,8 @@ class LPAStar {
   LPANode* goal_n;
   list<LPANode*> possible_goals;
   int min_goal_timestep;
+  vector<int> length_constraints;  // The timesteps of the length constraints, in the order they were added
+  vector< pair<int, int> > forever_constraints;  // (loc_id, first ts) of the vertex constraints that never end
   LPANode* start_n;
 
   DynamicConstraintsManager dcm;
@@ -97,19 +99,39 @@ class LPAStar {
   inline LPANode* openlistPopHead();
   inline LPANode* retrieveMinPred(LPANode* n);
   inline void updateState(LPANode* n, const std::vector < std::unordered_map<int, AvoidanceState > >& cat, bool bp_already_set=false);
+  inline bool isConstrainedForever(int loc_id, int t) const;
+  // The earliest timestep the path may end at under the length constraints and the constraints on the goal at or
+  // before last_ts
+  int minGoalTimestepUpTo(int last_ts);
+  // The nodes generated at loc_id at first_ts or later, by their timesteps
+  vector<LPANode*> nodesFrom(int loc_id, int first_ts);
 
   // Vertex constraint semantics: being at loc_id at time ts is disallowed (hence, a move from it to any neighbor at ts is disallowed).
   void addVertexConstraint(int loc_id, int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
   void popVertexConstraint(int loc_id, int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
+  // Range constraint semantics: being at loc_id at any time in first_ts..last_ts is disallowed. last_ts may be FOREVER.
+  void addVertexRangeConstraint(int loc_id, int first_ts, int last_ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
+  void popVertexRangeConstraint(int loc_id, int first_ts, int last_ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
   // Edge constraint semantics: moving from from_id to to_id and arriving there at ts is disallowed.
   void addEdgeConstraint(int from_id, int to_id, int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
   void popEdgeConstraint(int from_id, int to_id, int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
+  // Length constraint semantics: the path may not end (reach the goal and stay there) at or before ts.
+  void addLengthConstraint(int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
+  void popLengthConstraint(int ts, const std::vector < std::unordered_map<int, AvoidanceState > >& cat);  // Also calls updateState.
 
   // Finds a new path, returns whether a solution was found
   bool findPath(const std::vector < std::unordered_map<int, AvoidanceState > >& cat, int fLowerBound, int minTimestep);
 
   void updateGoal();
 
+/* Fills widths with the number of nodes at each timestep of the MDD of the agent's paths of the current optimal cost
+   (goal_n->t_), under the constraints the instance has. Nodes are on the MDD iff their g-value plus the (exact)
+   heuristic equals the cost, so a backward sweep from the goal over consistent nodes finds them.
+   Returns false if the instance's state can't tell: no path was found, or constraints were added or popped since the
+   last findPath.
+*/
+  bool getMDDWidths(vector<int>& widths);
+
   string openToString(bool print_priorities) const;
   LPAStar(const LPAStar& other);  // Copy ctor (deep copy).  When splitting this is needed
   ~LPAStar();  // Dtor.
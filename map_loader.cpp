@@ -33,6 +33,7 @@ MapLoader::MapLoader(int rows, int cols) {
   for (i=0; i<rows; i++)
     this->my_map[linearize_coordinate(i,j)] = true;
 
+  findCorridors();
 }
 
 MapLoader::MapLoader(string fname){
@@ -68,6 +69,7 @@ MapLoader::MapLoader(string fname){
     moves_offset[MapLoader::valid_moves_t::EAST] = 1;
     moves_offset[MapLoader::valid_moves_t::SOUTH] = cols;
     moves_offset[MapLoader::valid_moves_t::WEST] = -1;
+    findCorridors();
   }
   else
     cerr << "Map file not found." << std::endl;
@@ -154,3 +156,53 @@ void MapLoader::printPath(vector<int> path) {
   }
   cout << endl;
 }
+
+// A chain that closes into a cycle, or whose two ends lead to the same cell, isn't a corridor - there's no single
+// way through it.
+void MapLoader::findCorridors() {
+  corridors.clear();
+  corridor_of.assign(rows * cols, -1);
+  // Fills neighbors with the free neighbors of the cell and returns their number
+  auto free_neighbors = [&](int loc, int* neighbors) {
+    int num_neighbors = 0;
+    for (int direction = 0; direction < WAIT_MOVE; direction++) {
+      int next = loc + moves_offset[direction];
+      if (0 <= next && next < rows * cols && abs(next % cols - loc % cols) < 2 && !my_map[next])
+        neighbors[num_neighbors++] = next;
+    }
+    return num_neighbors;
+  };
+  vector<bool> visited(rows * cols, false);
+  int neighbors[4];
+  for (int loc = 0; loc < rows * cols; loc++) {
+    if (my_map[loc] || visited[loc] || free_neighbors(loc, neighbors) != 2)
+      continue;
+    // Follow the chain from the cell to both of its ends
+    vector<int> cells(1, loc);
+    visited[loc] = true;
+    int entrances[2];
+    bool cycle = false;
+    int first_neighbors[2] = {neighbors[0], neighbors[1]};
+    for (int side = 0; side < 2 && !cycle; side++) {
+      int prev = loc;
+      int curr = first_neighbors[side];
+      while (free_neighbors(curr, neighbors) == 2) {
+        if (curr == loc) {
+          cycle = true;
+          break;
+        }
+        visited[curr] = true;
+        cells.push_back(curr);
+        int next = neighbors[0] == prev ? neighbors[1] : neighbors[0];
+        prev = curr;
+        curr = next;
+      }
+      entrances[side] = curr;
+    }
+    if (cycle || entrances[0] == entrances[1])
+      continue;
+    for (int cell : cells)
+      corridor_of[cell] = (int)corridors.size();
+    corridors.push_back(Corridor{entrances[0], entrances[1], (int)cells.size() + 1});
+  }
+}
@@ -12,6 +12,15 @@ class MapLoader {
   enum valid_moves_t { NORTH, EAST, SOUTH, WEST, WAIT_MOVE, MOVE_COUNT };  // MOVE_COUNT is the enum's size
   int* moves_offset;
 
+  // A maximal chain of free cells with exactly two free neighbors each
+  struct Corridor {
+    int entrance1;  // the free cells just outside the two ends of the chain
+    int entrance2;
+    int length;  // moves it takes to get from one entrance to the other through the corridor
+  };
+  std::vector<Corridor> corridors;
+  std::vector<int> corridor_of;  // the index of the corridor each cell is in, or -1 if it isn't in one
+
   MapLoader(){}
   MapLoader(std::string fname); // load map from file
   MapLoader(int rows, int cols); // initialize new [rows x cols] empty map
@@ -28,6 +37,7 @@ class MapLoader {
   inline int col_coordinate(int id) const { return id % this->cols; }
   void printPath (std::vector<int> path);
   void saveToFile(std::string fname);
+  void findCorridors();  // fills corridors and corridor_of
 
   ~MapLoader();
 };
@@ -0,0 +1,39 @@
+#include "mdd_cache.h"
+
+std::shared_ptr<const MDD> MDDCache::lookup(const MDDCacheKey& key, clock_t& build_time)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = index.find(key);
+	if (it == index.end())
+		return nullptr;
+	entries.splice(entries.begin(), entries, it->second);  // Mark as most recently used
+	build_time = it->second->build_time;
+	return it->second->mdd;
+}
+
+void MDDCache::insert(const MDDCacheKey& key, const std::shared_ptr<const MDD>& mdd, clock_t build_time)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (max_bytes == 0 || index.find(key) != index.end())
+		return;
+	size_t bytes = sizeof(Entry) + 2 * sizeof(void*) +  // the entry and its list node
+	               sizeof(MDDCacheKey) + sizeof(list<Entry>::iterator) + 2 * sizeof(void*) +  // its index node
+	               mdd->memoryUsage();
+	entries.push_front(Entry{key, mdd, build_time, bytes});
+	index[key] = entries.begin();
+	used_bytes += bytes;
+	while (used_bytes > max_bytes && !entries.empty())  // Evict the least recently used MDDs
+	{
+		used_bytes -= entries.back().bytes;
+		index.erase(entries.back().key);
+		entries.pop_back();
+	}
+}
+
+void MDDCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+	index.clear();
+	used_bytes = 0;
+}
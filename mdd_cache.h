@@ -0,0 +1,71 @@
+#pragma once
+
+#include "MDD.h"
+
+#include <mutex>
+#include <unordered_map>
+
+// (agent, start of the MDD, goal of the MDD, lookahead, hashes of the agent's constraints)
+// The start and goal are (location, timestep) pairs. They're the agent's start and goal unless the agent has
+// landmarks, in which case the MDD only spans the segment between two of them. The cost of the MDD is
+// goal_timestep - start_timestep. Only the first of the hashes is hashed - the second is a check that tells apart
+// constraints whose first hashes collide.
+struct MDDCacheKey {
+	int agent;
+	int start_location;
+	int start_timestep;
+	int goal_location;
+	int goal_timestep;
+	int lookahead;
+	pair<size_t, size_t> constraints_hash;
+	bool operator==(const MDDCacheKey& other) const {
+		return agent == other.agent && start_location == other.start_location &&
+		       start_timestep == other.start_timestep && goal_location == other.goal_location &&
+		       goal_timestep == other.goal_timestep && lookahead == other.lookahead &&
+		       constraints_hash == other.constraints_hash;
+	}
+};
+
+// Caches the MDDs built for conflict classification, so sibling and descendant CT nodes that share an agent's
+// constraints don't build the same MDD again, and a node that added a single constraint on an agent can derive the
+// agent's MDD from the one its parent had.
+// The cache is limited to a budget of bytes. When it's exceeded, the least recently used MDDs are evicted.
+// The threads of a parallel search share the cache.
+class MDDCache
+{
+public:
+	size_t max_bytes = 0;  // 0 disables the cache
+
+	// Returns the MDD with the given key, or nullptr if it isn't in the cache.
+	// Also sets build_time to how long it took to build the MDD when it was added.
+	std::shared_ptr<const MDD> lookup(const MDDCacheKey& key, clock_t& build_time);
+	void insert(const MDDCacheKey& key, const std::shared_ptr<const MDD>& mdd, clock_t build_time);
+	void clear();
+	inline size_t size() const { return entries.size(); }
+	inline size_t bytes() const { return used_bytes; }
+
+private:
+	struct MDDCacheKeyHasher {
+		std::size_t operator()(const MDDCacheKey& k) const {
+			size_t seed = std::hash<int>()(k.agent);
+			seed ^= std::hash<int>()(k.start_location) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= std::hash<int>()(k.start_timestep) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= std::hash<int>()(k.goal_location) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= std::hash<int>()(k.goal_timestep) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= std::hash<int>()(k.lookahead) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= k.constraints_hash.first + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			return seed;
+		}
+	};
+	struct Entry {
+		MDDCacheKey key;
+		std::shared_ptr<const MDD> mdd;
+		clock_t build_time;
+		size_t bytes;  // of the entry, its MDD and its index node
+	};
+
+	list<Entry> entries;  // most recently used first
+	std::unordered_map<MDDCacheKey, list<Entry>::iterator, MDDCacheKeyHasher> index;
+	size_t used_bytes = 0;
+	std::mutex mutex;
+};
@@ -0,0 +1,79 @@
+#include "mutex_propagation.h"
+
+bool MutexPropagation::propagate()
+{
+	first_mutex_level = -1;
+	int num_levels = max(mdd1.numLevels(), mdd2.numLevels());
+	// The nodes of a level of an MDD, or its goal node past its end
+	auto begin = [](const MDD& mdd, int level) {
+		return level < mdd.numLevels() ? mdd.levelBegin(level) : mdd.levelBegin(mdd.numLevels() - 1);
+	};
+	auto end = [](const MDD& mdd, int level) {
+		return level < mdd.numLevels() ? mdd.levelEnd(level) : mdd.levelEnd(mdd.numLevels() - 1);
+	};
+
+	// reachable[i * width2 + j] - whether the i'th node of the level of mdd1 and the j'th of mdd2 aren't mutex
+	int width2 = end(mdd2, 0) - begin(mdd2, 0);
+	vector<bool> reachable(1, mdd1.location(begin(mdd1, 0)) != mdd2.location(begin(mdd2, 0)));
+	for (int level = 0; ; level++)
+	{
+		if (std::find(reachable.begin(), reachable.end(), true) == reachable.end())
+		{
+			first_mutex_level = level;
+			return true;
+		}
+		if (level == num_levels - 1)
+			return false;
+
+		int first1 = begin(mdd1, level), first2 = begin(mdd2, level);
+		int next_first1 = begin(mdd1, level + 1), next_first2 = begin(mdd2, level + 1);
+		int next_width2 = end(mdd2, level + 1) - next_first2;
+		vector<bool> next_reachable((end(mdd1, level + 1) - next_first1) * next_width2, false);
+		// The children of a node, or the node itself if it's the goal and the MDD ended
+		auto forEachChild = [&](const MDD& mdd, int node, int l, auto f) {
+			if (l + 1 >= mdd.numLevels())
+				f(node);
+			else
+				for (int i = mdd.childBegin(node); i < mdd.childEnd(node); i++)
+					if (mdd.child(i) >= 0)
+						f(mdd.child(i));
+		};
+		for (int i = 0; i < (int)reachable.size(); i++)
+		{
+			if (!reachable[i])
+				continue;
+			int u = first1 + i / width2, v = first2 + i % width2;
+			forEachChild(mdd1, u, level, [&](int next_u) {
+				forEachChild(mdd2, v, level, [&](int next_v) {
+					if (mdd1.location(next_u) == mdd2.location(next_v) ||  // vertex conflict
+					    (mdd1.location(u) == mdd2.location(next_v) &&
+					     mdd2.location(v) == mdd1.location(next_u)))  // edge conflict
+						return;
+					next_reachable[(next_u - next_first1) * next_width2 + next_v - next_first2] = true;
+				});
+			});
+		}
+		reachable.swap(next_reachable);
+		width2 = next_width2;
+	}
+}
+
+bool MutexPropagation::getSymmetricConstraints(vector<Constraint>& constraints1, vector<Constraint>& constraints2) const
+{
+	int last_level = min(mdd1.numLevels(), mdd2.numLevels()) - 1;
+	if (first_mutex_level < 0 || first_mutex_level > last_level)
+		return false;
+	int cut = first_mutex_level;
+	for (int level = first_mutex_level + 1; level <= last_level; level++)
+		if (mdd1.width(level) + mdd2.width(level) < mdd1.width(cut) + mdd2.width(cut))
+			cut = level;
+	constraints1.clear();
+	constraints2.clear();
+	for (int node = mdd1.levelBegin(cut); node < mdd1.levelEnd(cut); node++)
+		if (!mdd1.isRemoved(node))
+			constraints1.emplace_back(mdd1.location(node), -1, cut, false);
+	for (int node = mdd2.levelBegin(cut); node < mdd2.levelEnd(cut); node++)
+		if (!mdd2.isRemoved(node))
+			constraints2.emplace_back(mdd2.location(node), -1, cut, false);
+	return true;
+}
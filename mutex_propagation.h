@@ -0,0 +1,28 @@
+#pragma once
+
+#include "MDD.h"
+
+// Mutex propagation on the MDDs of two agents, both starting at timestep 0. Two nodes at the same level of the MDDs
+// are mutex if no pair of conflict-free paths of the agents' current costs gets to them - they're at the same
+// location, or every pair of their parents is mutex or swaps with them. The shorter MDD is extended by waiting at its
+// goal, so the agents' costs can't both stay as they are if their goals end up mutex.
+// Any path of an agent that gets to a node of its MDD on time got there through the MDD, so a level at which every
+// pair of nodes is mutex splits the agents symmetrically: one agent avoids all its nodes at the level, or the other
+// does. Both children of the split lose all the paths of the agent's current cost.
+class MutexPropagation
+{
+public:
+	MutexPropagation(const MDD& mdd1, const MDD& mdd2) : mdd1(mdd1), mdd2(mdd2) {}
+	// Propagates mutexes level by level until the goals are mutex or the last level of the longer MDD is reached.
+	// Returns whether the goals are mutex.
+	bool propagate();
+	// Fills each agent's negative vertex constraints on the nodes of the level with the fewest nodes among the levels
+	// of both MDDs at which every pair of nodes is mutex.
+	// Returns false if the first such level is past the end of the shorter MDD.
+	bool getSymmetricConstraints(vector<Constraint>& constraints1, vector<Constraint>& constraints2) const;
+
+private:
+	const MDD& mdd1;
+	const MDD& mdd2;
+	int first_mutex_level = -1;  // the first level at which every pair of nodes is mutex, -1 if the goals aren't
+};
@@ -0,0 +1,111 @@
+#include "occupancy_index.h"
+
+void OccupancyIndex::reset(int num_of_agents)
+{
+	occupants.clear();
+	parked.clear();
+	locations.assign(num_of_agents, vector<int>());
+	sources.assign(num_of_agents, nullptr);
+}
+
+void OccupancyIndex::addPath(int agent_id, const vector<PathEntry>* path)
+{
+	removePath(agent_id);
+	if (occupants.size() < path->size())
+		occupants.resize(path->size());
+	vector<int>& locs = locations[agent_id];
+	locs.resize(path->size());
+	for (size_t t = 0; t < path->size(); t++)
+	{
+		locs[t] = (*path)[t].location;
+		occupants[t][locs[t]].push_back(agent_id);
+	}
+	parked[locs.back()].push_back(agent_id);
+	sources[agent_id] = path;
+}
+
+void OccupancyIndex::removePath(int agent_id)
+{
+	vector<int>& locs = locations[agent_id];
+	if (locs.empty())
+		return;
+	for (size_t t = 0; t < locs.size(); t++)
+	{
+		auto it = occupants[t].find(locs[t]);
+		vector<int>& agents = it->second;
+		agents.erase(std::find(agents.begin(), agents.end(), agent_id));
+		if (agents.empty())
+			occupants[t].erase(it);
+	}
+	auto it = parked.find(locs.back());
+	vector<int>& agents = it->second;
+	agents.erase(std::find(agents.begin(), agents.end(), agent_id));
+	if (agents.empty())
+		parked.erase(it);
+	locs.clear();
+	sources[agent_id] = nullptr;
+}
+
+void OccupancyIndex::findConflicts(int agent_id, const vector<bool>& skip, ConflictPool& pool,
+                                   vector<ConflictId>& conflicts) const
+{
+	const vector<int>& path = locations[agent_id];
+	size_t path_length = path.size();
+	// <other agent, timestep, after one of the agents reached its goal, conflict>
+	vector<tuple<int, int, bool, Conflict>> found;
+
+	for (size_t t = 0; t < path_length; t++)
+	{
+		// Vertex conflicts with agents that are at the same location
+		auto it = occupants[t].find(path[t]);
+		if (it != occupants[t].end())
+		{
+			for (int other : it->second)
+				if (!skip[other])
+					found.emplace_back(other, t, false, Conflict(agent_id, other, path[t], -1, t));
+		}
+		// Edge conflicts with agents that arrive at our location from our next location
+		if (t + 1 < path_length && path[t] != path[t + 1])
+		{
+			it = occupants[t + 1].find(path[t]);
+			if (it != occupants[t + 1].end())
+			{
+				for (int other : it->second)
+					if (!skip[other] && locations[other][t] == path[t + 1])
+						found.emplace_back(other, t + 1, false, Conflict(agent_id, other, path[t], path[t + 1], t + 1));
+			}
+		}
+		// Vertex conflicts with agents that already reached their goal here
+		it = parked.find(path[t]);
+		if (it != parked.end())
+		{
+			for (int other : it->second)
+				if (!skip[other] && locations[other].size() <= t)
+					found.emplace_back(other, t, true, Conflict(other, agent_id, path[t], -1, t));
+		}
+	}
+	// Vertex conflicts with agents that pass through our goal after we reached it
+	for (size_t t = path_length; t < occupants.size(); t++)
+	{
+		auto it = occupants[t].find(path.back());
+		if (it == occupants[t].end())
+			continue;
+		for (int other : it->second)
+			if (!skip[other])
+				found.emplace_back(other, t, true, Conflict(agent_id, other, path.back(), -1, t));
+	}
+
+	std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+		return std::tie(std::get<0>(a), std::get<1>(a)) < std::tie(std::get<0>(b), std::get<1>(b));
+	});
+	vector<ConflictId> front;
+	for (const auto& [other, timestep, after_goal, conflict] : found)
+	{
+		if (after_goal)  // It's at least a semi cardinal conflict
+			front.push_back(pool.intern(conflict));
+		else
+			conflicts.push_back(pool.intern(conflict));
+	}
+	// The last one found goes first, as if each one was pushed to the front in turn
+	conflicts.insert(conflicts.begin(), front.rbegin(), front.rend());
+}
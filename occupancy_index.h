@@ -0,0 +1,38 @@
+#pragma once
+
+#include "common.h"
+#include "ICBSSingleAgentLLNode.h"
+#include "conflict_pool.h"
+
+// A space-time index of the paths of all agents, used to find the conflicts of a single path in time proportional
+// to its length instead of the number of agents.
+// Paths are tracked by address: syncPath only reindexes an agent if its path vector changed, so a path that was
+// modified in place must be reindexed explicitly with addPath.
+class OccupancyIndex
+{
+public:
+	void reset(int num_of_agents);
+
+	// (Re)index the path of the agent
+	void addPath(int agent_id, const vector<PathEntry>* path);
+	// Reindex the path of the agent only if it isn't the path that's already indexed for it
+	inline void syncPath(int agent_id, const vector<PathEntry>* path)
+	{
+		if (sources[agent_id] != path)
+			addPath(agent_id, path);
+	}
+	void removePath(int agent_id);
+
+	// Find the conflicts between the indexed path of the given agent and the paths of all agents that aren't skipped,
+	// intern them in the pool and add their IDs to the given list in the same order a pairwise scan over the other
+	// agents would: conflicts that occur after one of the agents reached its goal are added to the front of the list.
+	void findConflicts(int agent_id, const vector<bool>& skip, ConflictPool& pool, vector<ConflictId>& conflicts) const;
+
+private:
+	// occupants[t][loc] - the agents whose path is at loc at timestep t (only while the path lasts)
+	vector<std::unordered_map<int, vector<int>>> occupants;
+	// parked[loc] - the agents whose path ends at loc. They stay there from the timestep their path ends on.
+	std::unordered_map<int, vector<int>> parked;
+	vector<vector<int>> locations;  // the indexed path of each agent
+	vector<const vector<PathEntry>*> sources;  // where the indexed path of each agent came from
+};
@@ -0,0 +1,56 @@
+#include "task_pool.h"
+
+TaskPool::TaskPool(int num_threads)
+{
+	for (int i = 0; i < num_threads; i++)
+		threads.emplace_back(&TaskPool::run, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	task_added.notify_all();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void TaskPool::submit(std::function<void(int)> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push(std::move(task));
+	}
+	task_added.notify_one();
+}
+
+void TaskPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	tasks_done.wait(lock, [this] { return tasks.empty() && num_running == 0; });
+}
+
+void TaskPool::run(int thread_index)
+{
+	while (true)
+	{
+		std::function<void(int)> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			task_added.wait(lock, [this] { return stopping || !tasks.empty(); });
+			if (tasks.empty())  // stopping
+				return;
+			task = std::move(tasks.front());
+			tasks.pop();
+			num_running++;
+		}
+		task(thread_index);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			num_running--;
+		}
+		tasks_done.notify_all();
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that run the tasks submitted to them, in the order they were submitted.
+// Each task gets the index of the thread that runs it, so it can use state that belongs to that thread.
+class TaskPool
+{
+public:
+	explicit TaskPool(int num_threads);
+	~TaskPool();
+
+	void submit(std::function<void(int)> task);
+	// Blocks until all the tasks submitted so far are done
+	void wait();
+	inline int size() const { return (int)threads.size(); }
+
+private:
+	void run(int thread_index);
+
+	std::vector<std::thread> threads;
+	std::queue<std::function<void(int)>> tasks;
+	int num_running = 0;  // tasks that were taken from the queue and aren't done yet
+	bool stopping = false;
+	std::mutex mutex;
+	std::condition_variable task_added;
+	std::condition_variable tasks_done;
+};